@@ -170,7 +170,7 @@ QByteArray GrantleeView::render(Context *c) const
 
     QByteArray ret;
     c->setStash(d->cutelystVar, QVariant::fromValue(c));
-    const QVariantHash stash = c->stash();
+    const QVariantHash &stash = c->stash();
     auto it = stash.constFind(QStringLiteral("template"));
     QString templateFile;
     if (it != stash.constEnd()) {
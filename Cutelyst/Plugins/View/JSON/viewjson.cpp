@@ -96,7 +96,7 @@ QByteArray ViewJson::render(Context *c) const
 
     QJsonObject obj;
 
-    const QVariantHash stash = c->stash();
+    const QVariantHash &stash = c->stash();
 
     switch (d->exposeMode) {
     case All:
@@ -50,6 +50,27 @@ void Action::setMethod(const QMetaMethod &method)
     if (method.parameterCount() == 2 && method.parameterType(1) == QMetaType::QStringList) {
         d->listSignature = true;
     }
+
+    // The moc generated static metacall skips the signature checks
+    // and argument marshalling of QMetaMethod::invoke(), it can only be
+    // used when the method has one of the signatures doExecute() builds
+    const QMetaObject *meta = method.enclosingMetaObject();
+    bool direct = meta && meta->d.static_metacall &&
+            (method.returnType() == QMetaType::Void || method.returnType() == QMetaType::Bool);
+    if (direct && !d->listSignature) {
+        direct = method.parameterCount() <= 10;
+        for (int i = 1; direct && i < method.parameterCount(); ++i) {
+            direct = method.parameterType(i) == QMetaType::QString;
+        }
+    }
+
+    if (direct) {
+        d->staticMetacall = meta->d.static_metacall;
+        d->methodIndex = method.methodIndex() - meta->methodOffset();
+    } else {
+        d->staticMetacall = nullptr;
+        d->methodIndex = -1;
+    }
 }
 
 void Action::setController(Controller *controller)
@@ -155,6 +176,27 @@ bool Action::doExecute(Context *c)
         return false;
     }
 
+    if (d->staticMetacall) {
+        bool methodRet = true;
+        void *ret = d->evaluateBool ? &methodRet : nullptr;
+        const QStringList args = c->request()->args();
+        if (d->listSignature) {
+            void *argv[] = { ret, &c, const_cast<QStringList *>(&args) };
+            d->staticMetacall(d->controller, QMetaObject::InvokeMetaMethod, d->methodIndex, argv);
+        } else {
+            // Fill the missing arguments
+            const QString empty;
+            void *argv[11] = { ret, &c };
+            for (int i = 0; i < 9; ++i) {
+                argv[i + 2] = const_cast<QString *>(i < args.size() ? &args.at(i) : &empty);
+            }
+            d->staticMetacall(d->controller, QMetaObject::InvokeMetaMethod, d->methodIndex, argv);
+        }
+
+        c->setState(methodRet);
+        return methodRet;
+    }
+
     bool ret;
     if (d->evaluateBool) {
         bool methodRet;
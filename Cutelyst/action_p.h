@@ -29,6 +29,9 @@ class ActionPrivate
 public:
     QString ns;
     QMetaMethod method;
+    // moc generated call of the method, when it can be called directly
+    void (*staticMetacall)(QObject *, QMetaObject::Call, int, void **) = nullptr;
+    int methodIndex = -1;
     QMap<QString, QString> attributes;
     Controller *controller = nullptr;
     QStringList emptyArgs = QStringList()
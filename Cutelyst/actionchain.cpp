@@ -30,7 +30,7 @@ ActionChain::ActionChain(const ActionList &chain, QObject *parent) : Action(pare
     Q_D(ActionChain);
     d->chain = chain;
 
-    Action *final = d->chain.takeLast();
+    Action *final = d->chain.last();
     d->final = final;
 
     QVariantHash args;
@@ -77,7 +77,8 @@ bool ActionChain::doExecute(Context *c)
     Action *final = d->final;
 
     int captured = 0;
-    for (Action *action : chain) {
+    for (int i = 0; i < chain.size() - 1; ++i) {
+        Action *action = chain.at(i);
         QStringList args;
         while (args.size() < action->numberOfCaptures() && captured < captures.size()) {
             args.append(captures.at(captured++));
@@ -42,6 +42,10 @@ class CUTELYST_LIBRARY ActionChain : public Action
 public:
     /**
      * Constructs a ActionChain object with the folloing \p chain and the given \p parent.
+     *
+     * An ActionChain holds no per request state, the captures are taken from
+     * the Request, so the chains built by DispatchTypeChained are created once
+     * and shared by every request that matches them.
      */
     explicit ActionChain(const ActionList &chain, QObject *parent = nullptr);
     ~ActionChain();
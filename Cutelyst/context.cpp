@@ -23,7 +23,7 @@
 #include "request.h"
 #include "response.h"
 #include "action.h"
-#include "dispatcher.h"
+#include "dispatcher_p.h"
 #include "controller.h"
 #include "application.h"
 #include "stats.h"
@@ -198,6 +198,12 @@ QVariantHash &Context::stash()
     return d->stash;
 }
 
+const QVariantHash &Context::stash() const
+{
+    Q_D(const Context);
+    return d->stash;
+}
+
 QVariant Context::stash(const QString &key) const
 {
     Q_D(const Context);
@@ -210,6 +216,12 @@ void Context::setStash(const QString &key, const QVariant &value)
     d->stash.insert(key, value);
 }
 
+void Context::setStash(const QString &key, QVariant &&value)
+{
+    Q_D(Context);
+    d->stash[key] = std::move(value);
+}
+
 void Context::setStash(const QString &key, const ParamsMultiMap &map)
 {
     Q_D(Context);
@@ -241,19 +253,19 @@ QUrl Context::uriFor(const QString &path, const QStringList &args, const ParamsM
     }
     uri.setPath(_path, QUrl::DecodedMode);
 
-    QUrlQuery query;
-    if (!queryValues.isEmpty()) {
+    if (queryValues.isEmpty()) {
         // Avoid a trailing '?'
-        if (queryValues.size()) {
-            auto it = queryValues.constBegin();
-            const auto end = queryValues.constEnd();
-            while (it != end) {
-                query.addQueryItem(it.key(), it.value());
-                ++it;
-            }
+        uri.setQuery(QString());
+    } else {
+        QUrlQuery query;
+        auto it = queryValues.constBegin();
+        const auto end = queryValues.constEnd();
+        while (it != end) {
+            query.addQueryItem(it.key(), it.value());
+            ++it;
         }
+        uri.setQuery(query);
     }
-    uri.setQuery(query);
 
     return uri;
 }
@@ -271,9 +283,9 @@ QUrl Context::uriFor(Action *action, const QStringList &captures, const QStringL
     QStringList localArgs = args;
     QStringList localCaptures = captures;
 
-    Action *expandedAction = d->dispatcher->expandAction(const_cast<Context*>(this), action);
-    if (expandedAction->numberOfCaptures() > 0) {
-        while (localCaptures.size() < expandedAction->numberOfCaptures()
+    const DispatcherUriTemplate uriTemplate = d->dispatcher->d_ptr->uriTemplate(const_cast<Context*>(this), localAction);
+    if (uriTemplate.captures > 0) {
+        while (localCaptures.size() < uriTemplate.captures
                && localArgs.size()) {
             localCaptures.append(localArgs.takeFirst());
         }
@@ -284,6 +296,15 @@ QUrl Context::uriFor(Action *action, const QStringList &captures, const QStringL
         localCaptures = QStringList();
     }
 
+    if (uriTemplate.valid && localCaptures.size() == uriTemplate.captures) {
+        QString path = uriTemplate.parts.first();
+        for (int i = 0; i < uriTemplate.captures; ++i) {
+            path.append(localCaptures.at(i) + uriTemplate.parts.at(i + 1));
+        }
+        return uriFor(path, localArgs, queryValues);
+    }
+
+    // Let the dispatch types report why there is no path
     const QString path = d->dispatcher->uriForAction(localAction, localCaptures);
     if (path.isEmpty()) {
         qCWarning(CUTELYST_CORE) << "Can not find action for" << localAction << localCaptures;
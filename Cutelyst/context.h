@@ -229,6 +229,12 @@ public:
      */
     QVariantHash &stash();
 
+    /**
+     * Returns a read only reference to the stash, views should
+     * use it to iterate the stash without copying or detaching it.
+     */
+    const QVariantHash &stash() const;
+
     /**
      * A convenient method to retrieve a single value from the stash
      */
@@ -239,6 +245,11 @@ public:
      */
     void setStash(const QString &key, const QVariant &value);
 
+    /**
+     * A convenient method to set a single value to the stash, the value is moved into it
+     */
+    void setStash(const QString &key, QVariant &&value);
+
     /**
      * A convenient method to set a single ParamsMultiMap to the stash
      */
@@ -489,6 +500,7 @@ protected:
 
     friend class Application;
     friend class Action;
+    friend class Dispatcher;
     friend class DispatchType;
     friend class Plugin;
     friend class Engine;
@@ -81,6 +81,10 @@ class ControllerPrivate;
  *
  * \b :Local - Alias to Path="methodname".
  *
+ * \b :Dynamic - The match of this action depends on more than the
+ * request path (i.e. a custom ActionClass reimplementing match()), so the
+ * Dispatcher never caches it.
+ *
  * \b :Args - When used with "Path" it indicates the number of
  * arguments in the path.
  * \n The number is computed by counting the arguments the method expects.
@@ -29,6 +29,8 @@
 #include "request_p.h"
 #include "dispatchtypepath.h"
 #include "dispatchtypechained.h"
+#include "actionchain.h"
+#include "context_p.h"
 #include "utils.h"
 
 #include <QUrl>
@@ -114,6 +116,31 @@ void Dispatcher::setupActions(const QVector<Controller*> &controllers, const QVe
         ++i;
     }
 
+    // Chained only matches paths without arguments, so when no other
+    // dispatch type is in use the path tree can resolve all levels
+    d->pathDispatch = nullptr;
+    d->builtInTypes = true;
+    for (DispatchType *type : d->dispatchers) {
+        if (type->metaObject() == &DispatchTypePath::staticMetaObject) {
+            d->pathDispatch = static_cast<DispatchTypePath *>(type);
+        } else if (type->metaObject() != &DispatchTypeChained::staticMetaObject) {
+            d->builtInTypes = false;
+        }
+    }
+    if (!d->builtInTypes) {
+        d->pathDispatch = nullptr;
+    }
+
+    // Custom dispatch types might match on more than the path
+    int matchCacheSize = 0;
+    auto app = qobject_cast<Application *>(parent());
+    if (d->builtInTypes && app && app->engine()) {
+        const QVariantMap config = app->engine()->config(QLatin1String("Cutelyst_Dispatcher"));
+        matchCacheSize = config.value(QLatin1String("match_cache_size"), 512).toInt();
+    }
+    d->matchCache.clear();
+    d->matchCache.setMaxCost(qMax(matchCacheSize, 0));
+
     if (printActions) {
         d->printActions();
     }
@@ -161,7 +188,24 @@ void Dispatcher::prepareAction(Context *c)
     Q_D(Dispatcher);
 
     Request *request = c->request();
-    d->prepareAction(c, request->path());
+    const QString path = DispatcherPrivate::normalizePath(request->path());
+    if (d->matchCache.maxCost()) {
+        const DispatcherMatch *cached = d->matchCache.object(path);
+        if (cached) {
+            ++d->matchCacheHits;
+
+            request->setArguments(cached->args);
+            request->setCaptures(cached->captures);
+            request->setMatch(cached->match);
+            c->d_ptr->action = cached->action;
+        } else {
+            ++d->matchCacheMisses;
+            d->prepareAction(c, path);
+            d->cacheMatch(c, path);
+        }
+    } else {
+        d->prepareAction(c, path);
+    }
 
     static const auto &log = CUTELYST_DISPATCHER();
     if (log.isDebugEnabled()) {
@@ -177,7 +221,21 @@ void Dispatcher::prepareAction(Context *c)
 
 void DispatcherPrivate::prepareAction(Context *c, const QString &requestPath) const
 {
-    QString path = normalizePath(requestPath);
+    QString path = requestPath;
+
+    if (pathDispatch) {
+        // Every dispatch type gets a chance on the full path,
+        // then the remaining levels are resolved in a single descent
+        for (DispatchType *type : dispatchers) {
+            if (type->match(c, path, QStringList()) == DispatchType::ExactMatch) {
+                return;
+            }
+        }
+
+        pathDispatch->matchLongestPrefix(c, path);
+        return;
+    }
+
     QStringList args;
 
     //  "foo/bar"
@@ -207,6 +265,41 @@ void DispatcherPrivate::prepareAction(Context *c, const QString &requestPath) co
     }
 }
 
+void DispatcherPrivate::cacheMatch(Context *c, const QString &path)
+{
+    Action *action = c->action();
+    if (!action) {
+        return;
+    }
+
+    ActionList chain;
+    auto actionChain = qobject_cast<ActionChain *>(action);
+    if (actionChain) {
+        // Chains owned by the request can not outlive it
+        if (actionChain->parent() == c) {
+            return;
+        }
+        chain = actionChain->chain();
+    } else {
+        chain.append(action);
+    }
+
+    // Routes flagged as Dynamic must always be matched
+    for (Action *chained : chain) {
+        if (chained->attributes().contains(QStringLiteral("Dynamic"))) {
+            return;
+        }
+    }
+
+    auto match = new DispatcherMatch;
+    match->action = action;
+    Request *request = c->request();
+    match->args = request->args();
+    match->captures = request->captures();
+    match->match = request->match();
+    matchCache.insert(path, match);
+}
+
 Action *Dispatcher::getAction(const QString &name, const QString &nameSpace) const
 {
     Q_D(const Dispatcher);
@@ -277,6 +370,49 @@ QString Dispatcher::uriForAction(Action *action, const QStringList &captures) co
     return ret;
 }
 
+DispatcherUriTemplate DispatcherPrivate::uriTemplate(Context *c, Action *action)
+{
+    auto it = uriTemplates.constFind(action);
+    if (it != uriTemplates.constEnd()) {
+        return it.value();
+    }
+
+    Q_Q(Dispatcher);
+    DispatcherUriTemplate uriTemplate;
+    uriTemplate.captures = qMax<int>(0, q->expandAction(c, action)->numberOfCaptures());
+
+    // Private use characters mark where each capture goes
+    QStringList placeholders;
+    for (int i = 0; i < uriTemplate.captures; ++i) {
+        placeholders.append(QString(QChar(0xE000 + i)));
+    }
+
+    const QString path = q->uriForAction(action, placeholders);
+    if (!path.isNull()) {
+        uriTemplate.valid = true;
+
+        int from = 0;
+        for (const QString &placeholder : placeholders) {
+            const int pos = path.indexOf(placeholder, from);
+            if (pos == -1) {
+                uriTemplate.valid = false;
+                break;
+            }
+            uriTemplate.parts.append(path.mid(from, pos - from));
+            from = pos + 1;
+        }
+        uriTemplate.parts.append(path.mid(from));
+    }
+
+    // Chains expanded per request and other temporary actions
+    // must not be cached as their address might be reused
+    if (actions.value(action->ns() + QLatin1Char('/') + action->name()) == action) {
+        uriTemplates.insert(action, uriTemplate);
+    }
+
+    return uriTemplate;
+}
+
 Action *Dispatcher::expandAction(Context *c, Action *action) const
 {
     Q_D(const Dispatcher);
@@ -295,6 +431,18 @@ QVector<DispatchType *> Dispatcher::dispatchers() const
     return d->dispatchers;
 }
 
+quint64 Dispatcher::matchCacheHits() const
+{
+    Q_D(const Dispatcher);
+    return d->matchCacheHits;
+}
+
+quint64 Dispatcher::matchCacheMisses() const
+{
+    Q_D(const Dispatcher);
+    return d->matchCacheMisses;
+}
+
 QString DispatcherPrivate::cleanNamespace(const QString &ns)
 {
     QString ret = ns;
@@ -91,6 +91,22 @@ public:
      */
     QVector<DispatchType *> dispatchers() const;
 
+    /**
+     * Returns how many requests had their action resolved from the match cache.
+     *
+     * The match cache keeps the last matched actions, arguments and captures
+     * by request path, its size is set by the match_cache_size key of the
+     * Cutelyst_Dispatcher config section (default 512, 0 disables it).
+     * Actions with the Dynamic attribute are never cached.
+     */
+    quint64 matchCacheHits() const;
+
+    /**
+     * Returns how many requests were not found in the match cache
+     * and had to be matched by the dispatch types.
+     */
+    quint64 matchCacheMisses() const;
+
 protected:
     /**
      * Used by Application to register all Controllers Actions into the list of DispatchType
@@ -22,8 +22,29 @@
 
 #include "dispatcher.h"
 
+#include <QtCore/QCache>
+
 namespace Cutelyst {
 
+class DispatchTypePath;
+
+struct DispatcherMatch {
+    // ActionChains are shared by the dispatch type that matched them
+    Action *action = nullptr;
+    QStringList args;
+    QStringList captures;
+    QString match;
+};
+
+struct DispatcherUriTemplate {
+    // Literal parts of the path, captures go in between them
+    QStringList parts;
+    // Number of captures of the expanded action
+    int captures = 0;
+    // False when no dispatch type has a public path for the action
+    bool valid = false;
+};
+
 class DispatcherPrivate
 {
     Q_DECLARE_PUBLIC(Dispatcher)
@@ -31,6 +52,8 @@ public:
     DispatcherPrivate(Dispatcher *q) : q_ptr(q) {}
 
     inline void prepareAction(Context *c, const QString &requestPath) const;
+    inline void cacheMatch(Context *c, const QString &path);
+    DispatcherUriTemplate uriTemplate(Context *c, Action *action);
 
     void printActions() const;
     inline ActionList getContainers(const QString &ns) const;
@@ -46,6 +69,17 @@ public:
     ActionList rootActions;
     QMap<QString, Controller *> controllers;
     QVector<DispatchType*> dispatchers;
+    // Set when the path tree can resolve requests alone
+    DispatchTypePath *pathDispatch = nullptr;
+    // Keyed by the normalized request path
+    QCache<QString, DispatcherMatch> matchCache;
+    quint64 matchCacheHits = 0;
+    quint64 matchCacheMisses = 0;
+    // Built on the first uriFor() call for each registered action,
+    // those live as long as the dispatcher
+    QHash<Action *, DispatcherUriTemplate> uriTemplates;
+    // Only built-in dispatch types are known to match on the path alone
+    bool builtInTypes = true;
     Dispatcher *q_ptr;
 };
 
@@ -34,7 +34,7 @@ DispatchTypeChained::DispatchTypeChained(QObject *parent) : DispatchType(parent)
 
 DispatchTypeChained::~DispatchTypeChained()
 {
-
+    delete d_ptr;
 }
 
 QByteArray DispatchTypeChained::list() const
@@ -171,23 +171,31 @@ DispatchType::MatchType DispatchTypeChained::match(Context *c, const QString &pa
 
     Q_D(const DispatchTypeChained);
 
-    const BestActionMatch ret = d->recurseMatch(args.size(), QStringLiteral("/"), path.split(QLatin1Char('/')));
-    const ActionList chain = ret.actions;
-    if (ret.isNull || chain.isEmpty()) {
+    if (!d->root) {
+        return NoMatch;
+    }
+
+    const QVector<QStringRef> parts = path.splitRef(QLatin1Char('/'));
+    const BestActionMatch ret = d->recurseMatch(args.size(), d->root, parts, 0);
+    if (ret.isNull) {
         return NoMatch;
     }
 
     QStringList decodedArgs;
-    const QStringList parts = ret.parts;
-    for (const QString &arg : parts) {
-        QString aux = arg;
+    for (int i = ret.argsFrom; i < parts.size(); ++i) {
+        QString aux = parts[i].toString();
         decodedArgs.append(Utils::decodePercentEncoding(&aux));
     }
 
-    ActionChain *action = new ActionChain(chain, c);
+    QStringList captures;
+    for (int i : ret.captures) {
+        captures.append(parts[i].toString());
+    }
+
+    ActionChain *action = ret.endPoint->actionChain;
     Request *request = c->request();
     request->setArguments(decodedArgs);
-    request->setCaptures(ret.captures);
+    request->setCaptures(captures);
     request->setMatch(QLatin1Char('/') + action->reverse());
     setupMatchedAction(c, action);
 
@@ -332,6 +340,11 @@ Action *DispatchTypeChained::expandAction(Context *c, Action *action) const
         return 0;
     }
 
+    ActionChain *actionChain = d->chains.value(action);
+    if (actionChain) {
+        return actionChain;
+    }
+
     ActionList chain;
     Action *curr = action;
 
@@ -346,26 +359,122 @@ Action *DispatchTypeChained::expandAction(Context *c, Action *action) const
 
 bool DispatchTypeChained::inUse()
 {
-    Q_D(const DispatchTypeChained);
+    Q_D(DispatchTypeChained);
 
     if (d->actions.isEmpty()) {
         return false;
     }
 
-    // Optimize end points
+    // All actions are registered at this point
+    delete d->root;
+    d->chains.clear();
+    d->root = d->compile(QStringLiteral("/"));
 
     return true;
 }
 
-BestActionMatch DispatchTypeChainedPrivate::recurseMatch(int reqArgsSize, const QString &parent, const QStringList &pathParts) const
+BestActionMatch DispatchTypeChainedPrivate::recurseMatch(int reqArgsSize, const ChainedNode *node, const QVector<QStringRef> &pathParts, int pos) const
 {
     BestActionMatch bestAction;
-    auto it = childrenOf.constFind(parent);
-    if (it == childrenOf.constEnd()) {
-        return bestAction;
+    const int size = pathParts.size();
+
+    for (const ChainedChild &child : node->children) {
+        int partsPos = pos;
+        if (!child.pathPart.isEmpty()) {
+            const int tryPartCount = child.pathPart.size();
+            if (size - pos < tryPartCount) {
+                continue;
+            }
+
+            bool partMatches = true;
+            for (int i = 0; i < tryPartCount; ++i) {
+                if (pathParts[pos + i] != child.pathPart[i]) {
+                    partMatches = false;
+                    break;
+                }
+            }
+            if (!partMatches) {
+                continue;
+            }
+            partsPos += tryPartCount;
+        }
+
+        const int remainingParts = size - partsPos;
+        Action *action = child.action;
+        if (child.hasCaptureArgs) {
+            int captureCount = child.captureCount;
+            int localPos = partsPos + captureCount;
+            if (captureCount < 0) {
+                // CaptureArgs without a value captures all remaining parts
+                captureCount = remainingParts;
+                localPos = partsPos;
+            } else if (remainingParts < captureCount) {
+                // Short-circuit if not enough remaining parts
+                continue;
+            }
+
+            // check if the action may fit, depending on a given test by the app
+            if (!action->matchCaptures(captureCount)) {
+                continue;
+            }
+
+            // try the remaining parts against children of this action
+            const BestActionMatch ret = recurseMatch(reqArgsSize, child.node, pathParts, localPos);
+
+            //    No best action currently
+            // OR The action has less parts
+            // OR The action has equal parts but less captured data (ergo more defined)
+            const int actionParts = size - ret.argsFrom;
+            const int bestActionParts = size - bestAction.argsFrom;
+
+            if (!ret.isNull &&
+                    (bestAction.isNull ||
+                     actionParts < bestActionParts ||
+                     (actionParts == bestActionParts &&
+                      ret.captures.size() < bestAction.captures.size() &&
+                      ret.n_pathParts > bestAction.n_pathParts))) {
+                bestAction.endPoint = ret.endPoint;
+                bestAction.captures.clear();
+                for (int i = 0; i < captureCount; ++i) {
+                    bestAction.captures.append(partsPos + i);
+                }
+                bestAction.captures.append(ret.captures.constData(), ret.captures.size());
+                bestAction.argsFrom = ret.argsFrom;
+                bestAction.n_pathParts = child.n_pathParts + ret.n_pathParts;
+                bestAction.isNull = false;
+            }
+        } else {
+            if (!action->match(reqArgsSize + remainingParts)) {
+                continue;
+            }
+
+            //    No best action currently
+            // OR This one matches with fewer parts left than the current best action,
+            //    And therefore is a better match
+            // OR No parts and this expects 0
+            //    The current best action might also be Args(0),
+            //    but we couldn't chose between then anyway so we'll take the last seen
+
+            if (bestAction.isNull ||
+                    remainingParts < size - bestAction.argsFrom ||
+                    (remainingParts == 0 && child.argsZero)) {
+                bestAction.endPoint = &child;
+                bestAction.captures.clear();
+                bestAction.argsFrom = partsPos;
+                bestAction.n_pathParts = child.n_pathParts;
+                bestAction.isNull = false;
+            }
+        }
     }
 
-    const StringActionsMap children = it.value();
+    return bestAction;
+}
+
+ChainedNode *DispatchTypeChainedPrivate::compile(const QString &parent)
+{
+    auto node = new ChainedNode;
+
+    const StringActionsMap children = childrenOf.value(parent);
     QStringList keys = children.keys();
     std::sort(keys.begin(), keys.end(), [](const QString &a, const QString &b) -> bool {
         // action2 then action1 to try the longest part first
@@ -373,91 +482,48 @@ BestActionMatch DispatchTypeChainedPrivate::recurseMatch(int reqArgsSize, const
     });
 
     for (const QString &tryPart : keys) {
-        QStringList parts = pathParts;
-        if (!tryPart.isEmpty()) {
-            // We want to count the number of parts a split would give
-            // and remove the number of parts from tryPart
-            int tryPartCount = tryPart.count(QLatin1Char('/')) + 1;
-            const QStringList possiblePart = parts.mid(0, tryPartCount);
-            if (tryPart != possiblePart.join(QLatin1Char('/'))) {
-                continue;
-            }
-            parts = parts.mid(tryPartCount);
-        }
-
         const Actions tryActions = children.value(tryPart);
         for (Action *action : tryActions) {
             const QMap<QString, QString> attributes = action->attributes();
-            if (attributes.contains(QStringLiteral("CaptureArgs"))) {
-                const int captureCount = action->numberOfCaptures();
-                // Short-circuit if not enough remaining parts
-                if (parts.size() < captureCount) {
-                    continue;
-                }
-
-                // strip CaptureArgs into list
-                const QStringList captures = parts.mid(0, captureCount);
 
-                // check if the action may fit, depending on a given test by the app
-                if (!action->matchCaptures(captures.size())) {
-                    continue;
-                }
+            ChainedChild child;
+            child.action = action;
+            if (!tryPart.isEmpty()) {
+                child.pathPart = tryPart.split(QLatin1Char('/'));
+            }
+            child.n_pathParts = attributes.value(QStringLiteral("PathPart")).count(QLatin1Char('/')) + 1;
+            child.captureCount = action->numberOfCaptures();
+            child.hasCaptureArgs = attributes.contains(QStringLiteral("CaptureArgs"));
+            child.argsZero = !attributes.value(QStringLiteral("Args")).isEmpty() && action->numberOfArgs() == 0;
 
-                const QStringList localParts = parts.mid(captureCount);
-
-                // try the remaining parts against children of this action
-                const BestActionMatch ret = recurseMatch(reqArgsSize, QLatin1Char('/') + action->reverse(), localParts);
-
-                //    No best action currently
-                // OR The action has less parts
-                // OR The action has equal parts but less captured data (ergo more defined)
-                ActionList actions = ret.actions;
-                const QStringList actionCaptures = ret.captures;
-                const QStringList actionParts = ret.parts;
-                int bestActionParts = bestAction.parts.size();
-
-                if (!actions.isEmpty() &&
-                        (bestAction.isNull ||
-                         actionParts.size() < bestActionParts ||
-                         (actionParts.size() == bestActionParts &&
-                          actionCaptures.size() < bestAction.captures.size() &&
-                          ret.n_pathParts > bestAction.n_pathParts))) {
-                    actions.prepend(action);
-                    int pathparts = attributes.value(QStringLiteral("PathPart")).count(QLatin1Char('/')) + 1;
-                    bestAction.actions = actions;
-                    bestAction.captures = captures + actionCaptures;
-                    bestAction.parts = actionParts;
-                    bestAction.n_pathParts = pathparts + ret.n_pathParts;
-                    bestAction.isNull = false;
-                }
+            if (child.hasCaptureArgs) {
+                child.node = compile(QLatin1Char('/') + action->reverse());
             } else {
-                if (!action->match(reqArgsSize + parts.size())) {
-                    continue;
+                ActionList chain;
+                Action *curr = action;
+                while (curr) {
+                    chain.prepend(curr);
+                    curr = actions.value(curr->attribute(QStringLiteral("Chained")));
                 }
 
-                const QString argsAttr = attributes.value(QStringLiteral("Args"));
-                const int pathparts = attributes.value(QStringLiteral("PathPart")).count(QLatin1Char('/')) + 1;
-                //    No best action currently
-                // OR This one matches with fewer parts left than the current best action,
-                //    And therefore is a better match
-                // OR No parts and this expects 0
-                //    The current best action might also be Args(0),
-                //    but we couldn't chose between then anyway so we'll take the last seen
-
-                if (bestAction.isNull ||
-                        parts.size() < bestAction.parts.size() ||
-                        (parts.isEmpty() && !argsAttr.isEmpty() && action->numberOfArgs() == 0)) {
-                    bestAction.actions = { action };
-                    bestAction.captures = QStringList();
-                    bestAction.parts = parts;
-                    bestAction.n_pathParts = pathparts;
-                    bestAction.isNull = false;
-                }
+                // Immutable, so a single instance serves every request
+                child.actionChain = new ActionChain(chain);
+                chains.insert(action, child.actionChain);
             }
+
+            node->children.push_back(child);
         }
     }
 
-    return bestAction;
+    return node;
+}
+
+ChainedNode::~ChainedNode()
+{
+    for (const ChainedChild &child : children) {
+        delete child.node;
+        delete child.actionChain;
+    }
 }
 
 bool DispatchTypeChainedPrivate::checkArgsAttr(Action *action, const QString &name) const
@@ -20,6 +20,9 @@
 #define DISPATCHTYPECHAINED_P_H
 
 #include "dispatchtypechained.h"
+#include "actionchain.h"
+
+#include <QtCore/QVarLengthArray>
 #include <vector>
 
 namespace Cutelyst {
@@ -29,10 +32,34 @@ typedef std::vector<Action *> Actions;
 typedef QHash<QString, Actions> StringActionsMap;
 typedef QHash<QString, StringActionsMap> StringStringActionsMap;
 
+struct ChainedNode;
+struct ChainedChild {
+    Action *action;
+    // PathPart already split, empty when PathPart is empty
+    QStringList pathPart;
+    // Shared chain ending on this action, only for end points
+    ActionChain *actionChain = nullptr;
+    // Children of actions with CaptureArgs
+    ChainedNode *node = nullptr;
+    int n_pathParts;
+    int captureCount;
+    bool hasCaptureArgs;
+    bool argsZero;
+};
+
+struct ChainedNode {
+    ~ChainedNode();
+
+    // Sorted with the longest PathPart first
+    std::vector<ChainedChild> children;
+};
+
 struct BestActionMatch {
-    ActionList actions;
-    QStringList captures;
-    QStringList parts;
+    const ChainedChild *endPoint = nullptr;
+    // Indexes of the captured path parts
+    QVarLengthArray<int, 16> captures;
+    // Index of the first path part that is an argument
+    int argsFrom = 0;
     int n_pathParts = 0;
     bool isNull = true;
 };
@@ -40,7 +67,10 @@ struct BestActionMatch {
 class DispatchTypeChainedPrivate
 {
 public:
-    BestActionMatch recurseMatch(int reqArgsSize, const QString &parent, const QStringList &pathParts) const;
+    ~DispatchTypeChainedPrivate() { delete root; }
+
+    BestActionMatch recurseMatch(int reqArgsSize, const ChainedNode *node, const QVector<QStringRef> &pathParts, int pos) const;
+    ChainedNode *compile(const QString &parent);
     bool checkArgsAttr(Action *action, const QString &name) const;
     static QString listExtraHttpMethods(Action *action);
     static QString listExtraConsumes(Action *action);
@@ -48,6 +78,10 @@ public:
     Actions endPoints;
     StringActionMap actions;
     StringStringActionsMap childrenOf;
+    // Compiled from childrenOf once all actions are registered
+    ChainedNode *root = nullptr;
+    // End point actions to their chain, owned by root
+    QHash<Action *, ActionChain *> chains;
 };
 
 }
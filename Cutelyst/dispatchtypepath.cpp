@@ -24,6 +24,7 @@
 
 #include <QBuffer>
 #include <QRegularExpression>
+#include <QVarLengthArray>
 #include <QDebug>
 
 using namespace Cutelyst;
@@ -79,26 +80,21 @@ Cutelyst::DispatchType::MatchType DispatchTypePath::match(Context *c, const QStr
 {
     Q_D(const DispatchTypePath);
 
-    QString _path = path;
-    if (_path.isEmpty()) {
-        _path = QStringLiteral("/");
-    }
-
-    const auto it = d->paths.constFind(_path);
-    if (it == d->paths.constEnd()) {
+    const PathNode *node = d->findNode(path);
+    if (!node) {
         return NoMatch;
     }
 
     MatchType ret = NoMatch;
     int numberOfArgs = args.size();
-    for (Action *action : it.value()) {
+    for (Action *action : node->actions) {
         // If the number of args is -1 (not defined)
         // it will slurp all args so we don't care
         // about how many args was passed
         if (action->numberOfArgs() == numberOfArgs) {
             Request *request = c->request();
             request->setArguments(args);
-            request->setMatch(_path);
+            request->setMatch(node->path);
             setupMatchedAction(c, action);
             return ExactMatch;
         } else if (action->numberOfArgs() == -1 &&
@@ -107,7 +103,7 @@ Cutelyst::DispatchType::MatchType DispatchTypePath::match(Context *c, const QStr
             // currently set
             Request *request = c->request();
             request->setArguments(args);
-            request->setMatch(_path);
+            request->setMatch(node->path);
             setupMatchedAction(c, action);
             ret = PartialMatch;
         }
@@ -115,6 +111,80 @@ Cutelyst::DispatchType::MatchType DispatchTypePath::match(Context *c, const QStr
     return ret;
 }
 
+Cutelyst::DispatchType::MatchType DispatchTypePath::matchLongestPrefix(Context *c, const QString &path) const
+{
+    Q_D(const DispatchTypePath);
+
+    // Nodes having actions found while descending the tree,
+    // with the path position where their arguments start
+    QVarLengthArray<std::pair<const PathNode *, int>, 16> nodes;
+    QVarLengthArray<int, 16> depths;
+
+    const int size = path.size();
+    const PathNode *node = &d->root;
+    int depth = 0;
+    if (!node->actions.empty()) {
+        nodes.append({ node, 0 });
+        depths.append(depth);
+    }
+
+    int from = 0;
+    while (from < size) {
+        int to = path.indexOf(QLatin1Char('/'), from);
+        if (to == -1) {
+            to = size;
+        }
+
+        // Raw data avoids copying the part just for the lookup
+        auto it = node->children.constFind(QString::fromRawData(path.constData() + from, to - from));
+        if (it == node->children.constEnd()) {
+            break;
+        }
+
+        node = it.value();
+        from = to + 1;
+        ++depth;
+        if (!node->actions.empty()) {
+            nodes.append({ node, from });
+            depths.append(depth);
+        }
+    }
+
+    if (nodes.isEmpty()) {
+        return NoMatch;
+    }
+
+    int parts = 0;
+    if (size) {
+        parts = path.count(QLatin1Char('/')) + 1;
+    }
+
+    MatchType ret = NoMatch;
+    for (int i = nodes.size() - 1; i >= 0; --i) {
+        const PathNode *current = nodes[i].first;
+        const int numberOfArgs = parts - depths[i];
+        for (Action *action : current->actions) {
+            if (action->numberOfArgs() == numberOfArgs) {
+                Request *request = c->request();
+                request->setArguments(DispatchTypePathPrivate::decodeArgs(path, nodes[i].second));
+                request->setMatch(current->path);
+                setupMatchedAction(c, action);
+                return ExactMatch;
+            } else if (action->numberOfArgs() == -1 &&
+                       !c->action()) {
+                // Only setup partial matches if no action is
+                // currently set
+                Request *request = c->request();
+                request->setArguments(DispatchTypePathPrivate::decodeArgs(path, nodes[i].second));
+                request->setMatch(current->path);
+                setupMatchedAction(c, action);
+                ret = PartialMatch;
+            }
+        }
+    }
+    return ret;
+}
+
 bool DispatchTypePath::registerAction(Action *action)
 {
     Q_D(DispatchTypePath);
@@ -134,8 +204,16 @@ bool DispatchTypePath::registerAction(Action *action)
 
 bool DispatchTypePath::inUse()
 {
-    Q_D(const DispatchTypePath);
-    return !d->paths.isEmpty();
+    Q_D(DispatchTypePath);
+
+    if (d->paths.isEmpty()) {
+        return false;
+    }
+
+    // All actions are registered at this point
+    d->buildTree();
+
+    return true;
 }
 
 QString DispatchTypePath::uriForAction(Cutelyst::Action *action, const QStringList &captures) const
@@ -195,4 +273,74 @@ bool DispatchTypePathPrivate::registerPath(const QString &path, Action *action)
     return true;
 }
 
+void DispatchTypePathPrivate::buildTree()
+{
+    qDeleteAll(root.children);
+    root.children.clear();
+    root.actions.clear();
+
+    auto it = paths.constBegin();
+    while (it != paths.constEnd()) {
+        PathNode *node = &root;
+        if (it.key() != QLatin1String("/")) {
+            // Empty parts are kept so that paths registered
+            // with double slashes still never match
+            const QStringList parts = it.key().split(QLatin1Char('/'));
+            for (const QString &part : parts) {
+                PathNode *&child = node->children[part];
+                if (!child) {
+                    child = new PathNode;
+                }
+                node = child;
+            }
+        }
+        node->path = it.key();
+        node->actions = it.value();
+        ++it;
+    }
+}
+
+const PathNode *DispatchTypePathPrivate::findNode(const QString &path) const
+{
+    const PathNode *node = &root;
+    if (path.isEmpty() || path == QLatin1String("/")) {
+        return node->actions.empty() ? nullptr : node;
+    }
+
+    const int size = path.size();
+    int from = 0;
+    while (from <= size) {
+        int to = path.indexOf(QLatin1Char('/'), from);
+        if (to == -1) {
+            to = size;
+        }
+
+        auto it = node->children.constFind(QString::fromRawData(path.constData() + from, to - from));
+        if (it == node->children.constEnd()) {
+            return nullptr;
+        }
+        node = it.value();
+        from = to + 1;
+    }
+
+    return node->actions.empty() ? nullptr : node;
+}
+
+QStringList DispatchTypePathPrivate::decodeArgs(const QString &path, int from)
+{
+    QStringList ret;
+    const int size = path.size();
+    while (from < size) {
+        int to = path.indexOf(QLatin1Char('/'), from);
+        if (to == -1) {
+            to = size;
+        }
+
+        QString arg = path.mid(from, to - from);
+        ret.append(Utils::decodePercentEncoding(&arg));
+        from = to + 1;
+    }
+    return ret;
+}
+
 #include "moc_dispatchtypepath.cpp"
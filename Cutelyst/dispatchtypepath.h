@@ -41,6 +41,14 @@ public:
 
     virtual MatchType match(Context *c, const QString &path, const QStringList &args) const override;
 
+    /**
+     * Matches the normalized \p path in a single descent of the path tree,
+     * the longest registered path is tried first and the remaining path parts
+     * become the arguments, this is equivalent to calling match() for each
+     * path level from the full path down to the root.
+     */
+    MatchType matchLongestPrefix(Context *c, const QString &path) const;
+
     virtual bool registerAction(Action *action) override;
 
     virtual bool inUse() override;
@@ -28,12 +28,26 @@ namespace Cutelyst {
 typedef std::vector<Action *> Actions;
 typedef QHash<QString, Actions> StringActionsMap;
 
+struct PathNode {
+    ~PathNode() { qDeleteAll(children); }
+
+    // The registered path, used as Request::match()
+    QString path;
+    // Sorted by the number of args
+    Actions actions;
+    QHash<QString, PathNode *> children;
+};
+
 class DispatchTypePathPrivate
 {
 public:
     bool registerPath(const QString &path, Action *action);
+    void buildTree();
+    const PathNode *findNode(const QString &path) const;
+    static QStringList decodeArgs(const QString &path, int from);
 
     StringActionsMap paths;
+    PathNode root;
 };
 
 }
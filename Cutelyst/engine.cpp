@@ -64,6 +64,7 @@ Engine::Engine(Cutelyst::Application *app, int workerCore, const QVariantMap &op
 
     d->opts = opts;
     d->workerCore = workerCore;
+    d->postBufferingBufsize = opts.value(QStringLiteral("post_buffering_bufsize"), d->postBufferingBufsize).toInt();
 
     // If workerCore is greater than 0 we need a new application instance
     if (workerCore) {
@@ -439,6 +440,11 @@ void Engine::setConfig(const QVariantMap &config)
 {
     Q_D(Engine);
     d->config = config;
+
+    const QVariantMap request = config.value(QStringLiteral("Cutelyst_Request")).toMap();
+    d->formMaxSize = request.value(QStringLiteral("form_max_size"), d->formMaxSize).toLongLong();
+    d->formMaxFields = request.value(QStringLiteral("form_max_fields"), d->formMaxFields).toInt();
+    d->jsonMaxSize = request.value(QStringLiteral("json_max_size"), d->jsonMaxSize).toLongLong();
 }
 
 QVariantMap Engine::loadIniConfig(const QString &filename)
@@ -546,6 +552,26 @@ bool Engine::webSocketClose(Context *c, quint16 code, const QString &reason)
     return false;
 }
 
+QByteArray Engine::webSocketPrepareMessage(const QByteArray &payload, bool binary)
+{
+    Q_UNUSED(payload)
+    Q_UNUSED(binary)
+    return QByteArray();
+}
+
+bool Engine::webSocketSendFrame(Context *c, const QByteArray &frame)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(frame)
+    return false;
+}
+
+qint64 Engine::webSocketBytesToWrite(Context *c)
+{
+    Q_UNUSED(c)
+    return -1;
+}
+
 void Engine::processRequest(const QString &method,
                             const QString &path,
                             const QByteArray &query,
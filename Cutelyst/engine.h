@@ -68,7 +68,8 @@ public:
     /**
      * Constructs an Engine object, where \p app is the application that might be
      * used to create new instances if \p workerCore is greater than 1, \p opts
-     * is the options loaded by the engine subclass.
+     * is the options loaded by the engine subclass, \b post_buffering_bufsize
+     * sets the size of the chunks multipart bodies are parsed with.
      */
     explicit Engine(Application *app, int workerCore, const QVariantMap &opts);
     virtual ~Engine();
@@ -112,6 +113,11 @@ public:
 
     /**
      * Sets the configuration to be used by Application
+     *
+     * The \b Cutelyst_Request section sets the limits of url-encoded
+     * bodies, \b form_max_size in bytes (default 8MiB) and \b form_max_fields
+     * (default 1000), and of JSON bodies, \b json_max_size in bytes (default 10MiB),
+     * a value of 0 disables the limit.
      */
     void setConfig(const QVariantMap &config);
 
@@ -219,6 +225,24 @@ protected:
 
     virtual bool webSocketClose(Context *c, quint16 code, const QString &reason);
 
+    /**
+     * Returns a complete WebSocket message frame holding \p payload, which can be
+     * written to any number of connections with webSocketSendFrame(), engines
+     * without WebSocket support return an empty frame
+     */
+    virtual QByteArray webSocketPrepareMessage(const QByteArray &payload, bool binary);
+
+    /**
+     * Writes a \p frame created by webSocketPrepareMessage() to the connection of \p c
+     */
+    virtual bool webSocketSendFrame(Context *c, const QByteArray &frame);
+
+    /**
+     * Returns the number of bytes still waiting to be written to the connection
+     * of \p c, or -1 if the engine can't tell
+     */
+    virtual qint64 webSocketBytesToWrite(Context *c);
+
     /**
      * Returns the header key in camel case form
      */
@@ -312,6 +336,8 @@ private:
     Q_DECLARE_PRIVATE(Engine)
     friend class Application;
     friend class Response;
+    friend class RequestPrivate;
+    friend class WebSocketHubPrivate;
 
     /**
      * @brief init the engine
@@ -30,6 +30,13 @@ public:
     QVariantMap opts;
     QVariantMap config;
     Application *app;
+    // Limits of url-encoded bodies, 0 means no limit
+    qint64 formMaxSize = 8 * 1024 * 1024;
+    int formMaxFields = 1000;
+    // Limit of JSON bodies and of each streamed array element
+    qint64 jsonMaxSize = 10 * 1024 * 1024;
+    // Size of the chunks multipart bodies are read with
+    int postBufferingBufsize = 64 * 1024;
     int workerCore;
 };
 
@@ -19,6 +19,7 @@
 #include "headers_p.h"
 
 #include "common.h"
+#include "utils.h"
 
 #include <QStringList>
 
@@ -169,8 +170,7 @@ QString Headers::setDateWithDateTime(const QDateTime &date)
 {
     // ALL dates must be in GMT timezone http://www.w3.org/Protocols/rfc2616/rfc2616-sec3.html
     // and follow RFC 822
-    const QString dt = QLocale::c().toString(date.toUTC(),
-                                             QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT"));
+    const QString dt = Utils::httpDate(date);
     m_data.insert(QStringLiteral("DATE"), dt);
     return dt;
 }
@@ -234,8 +234,7 @@ QString Headers::setLastModified(const QDateTime &lastModified)
 {
     // ALL dates must be in GMT timezone http://www.w3.org/Protocols/rfc2616/rfc2616-sec3.html
     // and follow RFC 822
-    const auto dt = QLocale::c().toString(lastModified.toUTC(),
-                                          QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT"));
+    const QString dt = Utils::httpDate(lastModified);
     setLastModified(dt);
     return dt;
 }
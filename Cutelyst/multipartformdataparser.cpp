@@ -21,24 +21,208 @@
 #include "upload_p.h"
 #include "common.h"
 
+#include <QtCore/QBuffer>
+#include <QtCore/QTemporaryFile>
+
 using namespace Cutelyst;
 
+MultiPartFormDataParser::MultiPartFormDataParser(const QString &contentType, qint64 memoryLimit)
+    : d_ptr(new MultiPartFormDataParserPrivate)
+{
+    Q_D(MultiPartFormDataParser);
+    d->memoryLimit = memoryLimit;
+
+    const QByteArray boundary = MultiPartFormDataParserPrivate::boundary(contentType);
+    if (boundary.isEmpty()) {
+        d->state = MultiPartFormDataParserPrivate::StreamError;
+        return;
+    }
+
+    // Boundaries are preceded by CRLF except for the first,
+    // so the body is parsed as if it started with one
+    d->delimiter = "\r\n" + boundary;
+    d->matcher.setPattern(d->delimiter);
+    d->buffer = QByteArrayLiteral("\r\n");
+}
+
+MultiPartFormDataParser::~MultiPartFormDataParser()
+{
+    Q_D(MultiPartFormDataParser);
+    qDeleteAll(d->uploads);
+    delete d->device;
+    delete d_ptr;
+}
+
+bool MultiPartFormDataParser::feed(const char *data, qint64 len)
+{
+    Q_D(MultiPartFormDataParser);
+    if (d->state == MultiPartFormDataParserPrivate::StreamError) {
+        return false;
+    } else if (d->state == MultiPartFormDataParserPrivate::StreamDone) {
+        // Epilogue
+        return true;
+    }
+
+    d->buffer.append(data, int(len));
+
+    const int delimiterSize = d->delimiter.size();
+    int pos = 0;
+    bool needData = false;
+    while (!needData) {
+        switch (d->state) {
+        case MultiPartFormDataParserPrivate::StreamBoundary:
+        {
+            // Skip the preamble
+            const int i = d->matcher.indexIn(d->buffer.constData(), d->buffer.size(), pos);
+            if (i == -1) {
+                pos = qMax(pos, d->buffer.size() - delimiterSize + 1);
+                needData = true;
+            } else {
+                pos = i + delimiterSize;
+                d->state = MultiPartFormDataParserPrivate::StreamAfterBoundary;
+            }
+            break;
+        }
+        case MultiPartFormDataParserPrivate::StreamAfterBoundary:
+            // Optional linear white space before the line break
+            while (pos < d->buffer.size() && (d->buffer.at(pos) == ' ' || d->buffer.at(pos) == '\t')) {
+                ++pos;
+            }
+
+            if (d->buffer.size() - pos < 2) {
+                needData = true;
+            } else if (d->buffer.at(pos) == '-' && d->buffer.at(pos + 1) == '-') {
+                d->state = MultiPartFormDataParserPrivate::StreamDone;
+                d->buffer.clear();
+                return true;
+            } else if (d->buffer.at(pos) == '\r' && d->buffer.at(pos + 1) == '\n') {
+                pos += 2;
+                d->headersSize = 0;
+                d->state = MultiPartFormDataParserPrivate::StreamHeaders;
+            } else {
+                qCWarning(CUTELYST_MULTIPART) << "Invalid data after boundary";
+                d->state = MultiPartFormDataParserPrivate::StreamError;
+            }
+            break;
+        case MultiPartFormDataParserPrivate::StreamHeaders:
+        {
+            const int i = d->buffer.indexOf("\r\n", pos);
+            if (d->headersSize + (i == -1 ? d->buffer.size() : i) - pos > 8192) {
+                qCWarning(CUTELYST_MULTIPART) << "Part headers are too large";
+                d->state = MultiPartFormDataParserPrivate::StreamError;
+            } else if (i == -1) {
+                needData = true;
+            } else if (i == pos) {
+                pos += 2;
+                if (d->startPart()) {
+                    d->state = MultiPartFormDataParserPrivate::StreamData;
+                } else {
+                    d->state = MultiPartFormDataParserPrivate::StreamError;
+                }
+            } else {
+                MultiPartFormDataParserPrivate::parseHeaderLine(d->buffer.constData() + pos, i - pos, d->headers);
+                d->headersSize += i + 2 - pos;
+                pos = i + 2;
+            }
+            break;
+        }
+        case MultiPartFormDataParserPrivate::StreamData:
+        {
+            const int i = d->matcher.indexIn(d->buffer.constData(), d->buffer.size(), pos);
+            if (i == -1) {
+                // Keep what might be the start of a boundary
+                const int safe = d->buffer.size() - delimiterSize + 1;
+                if (safe > pos) {
+                    if (!d->writePart(d->buffer.constData() + pos, safe - pos)) {
+                        d->state = MultiPartFormDataParserPrivate::StreamError;
+                        break;
+                    }
+                    pos = safe;
+                }
+                needData = true;
+            } else if (d->writePart(d->buffer.constData() + pos, i - pos)) {
+                d->finishPart();
+                pos = i + delimiterSize;
+                d->state = MultiPartFormDataParserPrivate::StreamAfterBoundary;
+            } else {
+                d->state = MultiPartFormDataParserPrivate::StreamError;
+            }
+            break;
+        }
+        case MultiPartFormDataParserPrivate::StreamDone:
+            return true;
+        case MultiPartFormDataParserPrivate::StreamError:
+            d->buffer.clear();
+            return false;
+        }
+    }
+
+    d->buffer.remove(0, pos);
+    return true;
+}
+
+bool MultiPartFormDataParser::atEnd() const
+{
+    Q_D(const MultiPartFormDataParser);
+    return d->state == MultiPartFormDataParserPrivate::StreamDone;
+}
+
+Uploads MultiPartFormDataParser::takeUploads()
+{
+    Q_D(MultiPartFormDataParser);
+    Uploads ret = d->uploads;
+    d->uploads.clear();
+    return ret;
+}
+
 Uploads MultiPartFormDataParser::parse(QIODevice *body, const QString &contentType, int bufferSize)
 {
     Uploads ret;
+
+    if (bufferSize < 1024) {
+        bufferSize = 1024;
+    }
+    char *buffer = new char[bufferSize];
+
     if (body->isSequential()) {
-        qCWarning(CUTELYST_MULTIPART) << "Parsing sequential body is not supported" << body;
-        return ret;
+        // Can only be read once so each part is copied as it is parsed
+        MultiPartFormDataParser parser(contentType);
+        while (!parser.atEnd()) {
+            const qint64 len = body->read(buffer, bufferSize);
+            if (len <= 0) {
+                if (len < 0) {
+                    qCWarning(CUTELYST_MULTIPART) << "Error while reading POST body" << body->errorString();
+                }
+                break;
+            }
+
+            if (!parser.feed(buffer, len)) {
+                break;
+            }
+        }
+        ret = parser.takeUploads();
+    } else {
+        const QByteArray boundary = MultiPartFormDataParserPrivate::boundary(contentType);
+        if (!boundary.isEmpty()) {
+            ret = MultiPartFormDataParserPrivate::execute(buffer, bufferSize, body, boundary);
+        }
     }
 
+    delete [] buffer;
+
+    return ret;
+}
+
+QByteArray MultiPartFormDataParserPrivate::boundary(const QString &contentType)
+{
+    QByteArray boundary;
     int start = contentType.indexOf(QLatin1String("boundary="));
     if (start == -1) {
         qCWarning(CUTELYST_MULTIPART) << "No boudary match" << contentType;
-        return ret;
+        return boundary;
     }
 
     start += 9;
-    QByteArray boundary;
     const int len = contentType.length();
     boundary.reserve(contentType.length() - start + 2);
 
@@ -57,40 +241,87 @@ Uploads MultiPartFormDataParser::parse(QIODevice *body, const QString &contentTy
 
     if (boundary.isEmpty()) {
         qCWarning(CUTELYST_MULTIPART) << "Boudary match was empty" << contentType;
-        return ret;
+        return boundary;
     }
     boundary.prepend("--", 2);
 
-    if (bufferSize < 1024) {
-        bufferSize = 1024;
+    return boundary;
+}
+
+bool MultiPartFormDataParserPrivate::startPart()
+{
+    auto buffer = new QBuffer;
+    buffer->open(QIODevice::ReadWrite);
+    device = buffer;
+    return true;
+}
+
+bool MultiPartFormDataParserPrivate::writePart(const char *data, int len)
+{
+    if (!len) {
+        return true;
     }
-    char *buffer = new char[bufferSize];
 
-    ret = MultiPartFormDataParserPrivate::execute(buffer, bufferSize, body, boundary);
+    if (device->size() + len > memoryLimit && qobject_cast<QBuffer *>(device)) {
+        // Too large to keep in memory
+        auto temp = new QTemporaryFile;
+        if (!temp->open()) {
+            qCWarning(CUTELYST_MULTIPART) << "Failed to open temporary file to store upload" << temp->errorString();
+            delete temp;
+            return false;
+        }
 
-    delete [] buffer;
+        const QByteArray &memory = static_cast<QBuffer *>(device)->data();
+        temp->write(memory.constData(), memory.size());
+        delete device;
+        device = temp;
+    }
 
-    return ret;
+    if (device->write(data, len) != len) {
+        qCWarning(CUTELYST_MULTIPART) << "Failed to write upload" << device->errorString();
+        return false;
+    }
+    return true;
+}
+
+void MultiPartFormDataParserPrivate::finishPart()
+{
+    auto upload = new Upload(new UploadPrivate(device, headers, 0, device->size()));
+    // The upload owns the data of the part
+    device->setParent(upload);
+    device = nullptr;
+    uploads.append(upload);
+
+    headers = Headers();
 }
 
 Uploads MultiPartFormDataParserPrivate::execute(char *buffer, int bufferSize, QIODevice *body, const QByteArray &boundary)
 {
     Uploads ret;
-    QByteArray headerLine;
+    char headerLine[8192];
+    int headerLineSize = 0;
     Headers headers;
     qint64 startOffset;
     qint64 pos = 0;
     qint64 contentLength = body->size();
-    int bufferSkip = 0;
-    int boundarySize = boundary.size();
     ParserState state = FindBoundary;
-    QByteArrayMatcher matcher(boundary);
+    BoundaryMatcher matcher;
+    matcher.setPattern("\r\n" + boundary);
+    const int delimiterSize = matcher.size();
+
+    // Boundaries are preceded by CRLF except for the first,
+    // so the body is parsed as if it started with one
+    buffer[0] = '\r';
+    buffer[1] = '\n';
+    int bufferSkip = 2;
 
     while (pos < contentLength) {
         qint64 len = body->read(buffer + bufferSkip, bufferSize - bufferSkip);
         if (len < 0) {
             qCWarning(CUTELYST_MULTIPART) << "Error while reading POST body" << body->errorString();
             return ret;
+        } else if (len == 0) {
+            break;
         }
 
         pos += len;
@@ -100,8 +331,28 @@ Uploads MultiPartFormDataParserPrivate::execute(char *buffer, int bufferSize, QI
         while (i < len) {
             switch (state) {
             case FindBoundary:
-                i += findBoundary(buffer + i, len - i, matcher, boundarySize, state);
+            case EndData:
+            {
+                const int found = matcher.indexIn(buffer, int(len), i);
+                if (found == -1) {
+                    // Keep what might be the start of a boundary split between two chunks
+                    bufferSkip = qMin(delimiterSize - 1, int(len) - i);
+                    memmove(buffer, buffer + len - bufferSkip, bufferSkip);
+                    i = len;
+                    continue;
+                }
+
+                if (state == EndData) {
+//                    qCDebug(CUTELYST_MULTIPART) << "EndData" << pos - len + found;
+                    auto upload = new Upload(new UploadPrivate(body, headers, startOffset, pos - len + found));
+                    ret.append(upload);
+
+                    headers = Headers();
+                }
+                i = found + delimiterSize - 1;
+                state = EndBoundaryCR;
                 break;
+            }
             case EndBoundaryCR:
                 // TODO the "--" case
                 if (buffer[i] != '\r') {
@@ -118,27 +369,30 @@ Uploads MultiPartFormDataParserPrivate::execute(char *buffer, int bufferSize, QI
                 state = StartHeaders;
                 break;
             case StartHeaders:
-                if (headerLine.isEmpty() && buffer[i] == '\r') {
+                if (headerLineSize == 0 && buffer[i] == '\r') {
                     // nothing was read
                     state = EndHeaders;
                 } else {
                     char *pch = static_cast<char *>(memchr(buffer + i, '\r', len - i));
+                    const int size = (pch ? int(pch - buffer) : int(len)) - i;
+                    if (headerLineSize + size > int(sizeof(headerLine))) {
+                        qCWarning(CUTELYST_MULTIPART) << "Part header line is too large";
+                        return ret;
+                    }
+                    memcpy(headerLine + headerLineSize, buffer + i, size);
+                    headerLineSize += size;
                     if (pch == NULL) {
-                        headerLine.append(buffer + i, len - i);
                         i = len;
-                    } else {
-                        headerLine.append(buffer + i, pch - buffer - i);
-                        i = pch - buffer;
-                        state = FinishHeader;
+                        continue;
                     }
+                    i = pch - buffer;
+                    state = FinishHeader;
                 }
                 break;
             case FinishHeader:
                 if (buffer[i] == '\n') {
-                    int dotdot = headerLine.indexOf(':');
-                    headers.setHeader(QString::fromLatin1(headerLine.left(dotdot)),
-                                      QString::fromLatin1(headerLine.mid(dotdot + 1).trimmed()));
-                    headerLine = QByteArray();
+                    parseHeaderLine(headerLine, headerLineSize, headers);
+                    headerLineSize = 0;
                     state = StartHeaders;
                 } else {
 //                    qCDebug(CUTELYST_MULTIPART) << "FinishHeader return!";
@@ -154,27 +408,10 @@ Uploads MultiPartFormDataParserPrivate::execute(char *buffer, int bufferSize, QI
                 }
                 break;
             case StartData:
-//                qCDebug(CUTELYST_MULTIPART) << "StartData" << body->pos() - len + i;
+//                qCDebug(CUTELYST_MULTIPART) << "StartData" << pos - len + i;
                 startOffset = pos - len + i;
                 state = EndData;
-            case EndData:
-                i += findBoundary(buffer + i, len - i, matcher, boundarySize, state);
-
-                if (state == EndBoundaryCR) {
-//                    qCDebug(CUTELYST_MULTIPART) << "EndData" << body->pos() - len + i - boundaryLength - 1;
-                    int endOffset = pos - len + i - boundarySize - 1;
-                    auto upload = new Upload(new UploadPrivate(body, headers, startOffset, endOffset));
-                    ret.append(upload);
-
-                    headers = Headers();
-                } else {
-                    // Boundary was not found so move the boundary size at end of the buffer
-                    // to be sure we don't have the boundary in the middle of two chunks
-                    bufferSkip = boundarySize - 1;
-                    memmove(buffer, buffer + len - bufferSkip, bufferSkip);
-                }
-
-                break;
+                continue;
             }
             ++i;
         }
@@ -183,16 +420,25 @@ Uploads MultiPartFormDataParserPrivate::execute(char *buffer, int bufferSize, QI
     return ret;
 }
 
-int MultiPartFormDataParserPrivate::findBoundary(char *buffer, int len, const QByteArrayMatcher &matcher, int boundarySize, MultiPartFormDataParserPrivate::ParserState &state)
+void MultiPartFormDataParserPrivate::parseHeaderLine(const char *line, int len, Headers &headers)
 {
-    int i = matcher.indexIn(buffer, len);
-    //    qCDebug(CUTELYST_MULTIPART) << "findBoundary" << QByteArray(buffer, len);
-    if (i != -1) {
-        //        qCDebug(CUTELYST_MULTIPART) << "FindBoundary: found at" << i << body->pos() << len << body->pos() - len + i << i + boundaryLength;
-        state = EndBoundaryCR;
-        return i + boundarySize - 1;
+    const char *end = line + len;
+    const char *dotdot = static_cast<const char *>(memchr(line, ':', len));
+    if (!dotdot) {
+        headers.setHeader(QString::fromLatin1(line, len), QString());
+        return;
+    }
+
+    const char *value = dotdot + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        ++value;
+    }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
     }
-    return len;
+
+    headers.setHeader(QString::fromLatin1(line, int(dotdot - line)),
+                      QString::fromLatin1(value, int(end - value)));
 }
 
 #include "moc_multipartformdataparser_p.cpp"
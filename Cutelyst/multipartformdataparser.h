@@ -25,16 +25,57 @@
 
 namespace Cutelyst {
 
+class MultiPartFormDataParserPrivate;
 class CUTELYST_LIBRARY MultiPartFormDataParser
 {
+    Q_DECLARE_PRIVATE(MultiPartFormDataParser)
 public:
+    /**
+     * Constructs an incremental parser for a body of \p contentType, the body
+     * is pushed with feed() in chunks of any size and each part is written to its own
+     * device, parts up to \p memoryLimit bytes are kept in memory, larger ones
+     * are moved to a temporary file.
+     *
+     * Currently only parse() uses it, for sequential bodies, engines still spool
+     * the whole body before the Request parses it.
+     */
+    explicit MultiPartFormDataParser(const QString &contentType, qint64 memoryLimit = 64 * 1024);
+    ~MultiPartFormDataParser();
+
+    /**
+     * Parses the next \p len bytes of the body, returns false if
+     * the body is malformed, after that all data is ignored.
+     */
+    bool feed(const char *data, qint64 len);
+
+    /**
+     * Returns true once the closing boundary was parsed.
+     */
+    bool atEnd() const;
+
+    /**
+     * Returns the parts completed so far, the caller takes their ownership.
+     */
+    Uploads takeUploads();
+
     /**
      * @brief Parser for multipart/formdata
+     *
+     * Random access bodies are not copied, each Upload reads from its window of the \p body,
+     * sequential bodies are read once with the incremental parser.
+     *
      * @param body
      * @param contentType can be the whole HTTP Content-Type header or just it's value
-     * @param bufferSize is the internal buffer size used to parse
+     * @param bufferSize is the internal buffer size used to parse, engines use
+     * their post buffering size
      */
-    static Uploads parse(QIODevice *body, const QString &contentType, int bufferSize = 4096);
+    static Uploads parse(QIODevice *body, const QString &contentType, int bufferSize = 64 * 1024);
+
+protected:
+    MultiPartFormDataParserPrivate *d_ptr;
+
+private:
+    Q_DISABLE_COPY(MultiPartFormDataParser)
 };
 
 }
@@ -22,10 +22,48 @@
 
 #include "multipartformdataparser.h"
 
-#include <QByteArrayMatcher>
+#include <string.h>
 
 namespace Cutelyst {
 
+/**
+ * Finds a multipart delimiter, candidates are located with memchr() on the
+ * first byte of the pattern, which libc vectorizes, and only then compared.
+ * As delimiters start with CR, candidates are rare even on binary data.
+ */
+class BoundaryMatcher
+{
+public:
+    inline void setPattern(const QByteArray &pattern) { m_pattern = pattern; }
+    inline int size() const { return m_pattern.size(); }
+
+    inline int indexIn(const char *data, int len, int from = 0) const {
+        const int size = m_pattern.size();
+        if (size == 0 || len - from < size) {
+            return -1;
+        }
+
+        const char *pattern = m_pattern.constData();
+        const char last = pattern[size - 1];
+        const char *it = data + from;
+        const char *end = data + len - size + 1;
+        while (it < end) {
+            it = static_cast<const char *>(memchr(it, pattern[0], end - it));
+            if (!it) {
+                return -1;
+            }
+            if (it[size - 1] == last && memcmp(it, pattern, size - 1) == 0) {
+                return it - data;
+            }
+            ++it;
+        }
+        return -1;
+    }
+
+private:
+    QByteArray m_pattern;
+};
+
 class MultiPartFormDataParserPrivate
 {
     Q_GADGET
@@ -42,8 +80,33 @@ public:
     };
     Q_ENUM(ParserState)
 
+    enum StreamState {
+        StreamBoundary,
+        StreamAfterBoundary,
+        StreamHeaders,
+        StreamData,
+        StreamDone,
+        StreamError
+    };
+
     static Uploads execute(char *buffer, int bufferSize, QIODevice *body, const QByteArray &boundary);
-    static inline int findBoundary(char *buffer, int len, const QByteArrayMatcher &matcher, int boundarySize, ParserState &state);
+    static QByteArray boundary(const QString &contentType);
+    static inline void parseHeaderLine(const char *line, int len, Headers &headers);
+
+    inline bool startPart();
+    inline bool writePart(const char *data, int len);
+    inline void finishPart();
+
+    // Used by the incremental parser
+    Uploads uploads;
+    Headers headers;
+    QByteArray buffer;
+    QByteArray delimiter;
+    BoundaryMatcher matcher;
+    QIODevice *device = nullptr;
+    qint64 memoryLimit;
+    int headersSize = 0;
+    StreamState state = StreamBoundary;
 };
 
 }
@@ -17,14 +17,20 @@
  * Boston, MA 02110-1301, USA.
  */
 #include "request_p.h"
-#include "engine.h"
+#include "engine_p.h"
 #include "common.h"
 #include "multipartformdataparser.h"
 #include "utils.h"
 
 #include <QtCore/QJsonDocument>
+#include <QtCore/QJsonArray>
+#include <QtCore/QBuffer>
+#include <QtCore/QVarLengthArray>
 #include <QtNetwork/QHostInfo>
 
+#include <string.h>
+#include <algorithm>
+
 using namespace Cutelyst;
 
 Request::Request(RequestPrivate *prv) :
@@ -205,6 +211,35 @@ QVariant Request::bodyData() const
     return d->bodyData;
 }
 
+bool Request::readJsonArray(const std::function<bool(const QJsonValue &)> &callback)
+{
+    Q_D(Request);
+
+    QIODevice *body = d->body;
+    if (!body) {
+        return false;
+    }
+
+    const qint64 posOrig = body->pos();
+    if (body->isSequential()) {
+        if (posOrig) {
+            qCWarning(CUTELYST_REQUEST) << "Can not parse sequential post body out of beginning";
+            return false;
+        }
+    } else if (posOrig) {
+        body->seek(0);
+    }
+
+    const qint64 maxSize = d->engine ? d->engine->d_ptr->jsonMaxSize : 0;
+    bool ret = RequestPrivate::readJsonArray(body, maxSize, callback);
+
+    if (!body->isSequential()) {
+        body->seek(posOrig);
+    }
+
+    return ret;
+}
+
 QVariantMap Request::bodyParametersVariant() const
 {
     return RequestPrivate::paramsMultiMapToVariantMap(bodyParameters());
@@ -251,8 +286,15 @@ ParamsMultiMap Request::parameters() const
 {
     Q_D(const Request);
     if (!(d->parserStatus & RequestPrivate::ParamParsed)) {
-        d->param = queryParameters();
-        d->param.unite(bodyParameters());
+        const ParamsMultiMap query = queryParameters();
+        const ParamsMultiMap body = bodyParameters();
+        if (body.isEmpty()) {
+            d->param = query;
+        } else if (query.isEmpty()) {
+            d->param = body;
+        } else {
+            d->param = RequestPrivate::mergeParams(query, body);
+        }
         d->parserStatus |= RequestPrivate::ParamParsed;
     }
     return d->param;
@@ -261,11 +303,12 @@ ParamsMultiMap Request::parameters() const
 QString Request::cookie(const QString &name) const
 {
     Q_D(const Request);
-    if (!(d->parserStatus & RequestPrivate::CookiesParsed)) {
-        d->parseCookies();
+    if (d->parserStatus & RequestPrivate::CookiesParsed) {
+        return d->cookies.value(name);
     }
 
-    return d->cookies.value(name);
+    // Looking up a single cookie doesn't need the whole map
+    return d->findCookie(name);
 }
 
 QMap<QString, QString> Request::cookies() const
@@ -377,6 +420,18 @@ QUrl Request::uriWith(const ParamsMultiMap &args, bool append) const
     return ret;
 }
 
+void Request::setWebSocketStreaming(bool enable)
+{
+    Q_D(Request);
+    d->webSocketStreaming = enable;
+}
+
+bool Request::webSocketStreaming() const
+{
+    Q_D(const Request);
+    return d->webSocketStreaming;
+}
+
 Engine *Request::engine() const
 {
     Q_D(const Request);
@@ -395,10 +450,10 @@ void RequestPrivate::parseUrlQuery() const
     if (query.size()) {
         // Check for keywords (no = signs)
         if (query.indexOf('=') < 0) {
-            QByteArray aux = query;
-            queryKeywords = Utils::decodePercentEncoding(&aux);
+            queryKeywords = Utils::decodePercentEncoding(query.constData(), query.size());
         } else {
-            queryParam = parseUrlEncoded(query);
+            queryParam = parseUrlEncoded(query.constData(), query.size(),
+                                         engine ? engine->d_ptr->formMaxFields : 0);
         }
     }
     parserStatus |= RequestPrivate::QueryParsed;
@@ -423,18 +478,28 @@ void RequestPrivate::parseBody() const
     if (contentType == QLatin1String("application/x-www-form-urlencoded")) {
         // Parse the query (BODY) of type "application/x-www-form-urlencoded"
         // parameters ie "?foo=bar&bar=baz"
-        if (posOrig) {
-            body->seek(0);
-        }
+        const qint64 maxSize = engine ? engine->d_ptr->formMaxSize : 0;
+        const int maxFields = engine ? engine->d_ptr->formMaxFields : 0;
 
-        bodyParam = parseUrlEncoded(body->readLine());
+        bool tooLarge;
+        const QByteArray data = readBody(maxSize, &tooLarge);
+        if (tooLarge) {
+            qCWarning(CUTELYST_REQUEST) << "Url-encoded body is larger than" << maxSize << "bytes, ignoring it";
+        } else {
+            bodyParam = parseUrlEncoded(data.constData(), data.size(), maxFields);
+        }
         bodyData = QVariant::fromValue(bodyParam);
     } else if (contentType == QLatin1String("multipart/form-data")) {
         if (posOrig) {
             body->seek(0);
         }
 
-        uploads = MultiPartFormDataParser::parse(body, headers.header(QStringLiteral("CONTENT_TYPE")));
+        if (engine) {
+            uploads = MultiPartFormDataParser::parse(body, headers.header(QStringLiteral("CONTENT_TYPE")),
+                                                     engine->d_ptr->postBufferingBufsize);
+        } else {
+            uploads = MultiPartFormDataParser::parse(body, headers.header(QStringLiteral("CONTENT_TYPE")));
+        }
         auto it = uploads.crbegin();
         while (it != uploads.crend()) {
             Upload *upload = *it;
@@ -443,11 +508,15 @@ void RequestPrivate::parseBody() const
         }
         bodyData = QVariant::fromValue(uploadsMap);
     } else if (contentType == QLatin1String("application/json")) {
-        if (posOrig) {
-            body->seek(0);
-        }
+        const qint64 maxSize = engine ? engine->d_ptr->jsonMaxSize : 0;
 
-        bodyData = QJsonDocument::fromJson(body->readAll());
+        bool tooLarge;
+        const QByteArray data = readBody(maxSize, &tooLarge);
+        if (tooLarge) {
+            qCWarning(CUTELYST_REQUEST) << "JSON body is larger than" << maxSize << "bytes, use readJsonArray() to stream it";
+        } else {
+            bodyData = QJsonDocument::fromJson(data);
+        }
     }
 
     if (!sequencial) {
@@ -457,6 +526,151 @@ void RequestPrivate::parseBody() const
     parserStatus |= RequestPrivate::BodyParsed;
 }
 
+static inline bool isJsonSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static bool emitJsonElement(const QByteArray &element, const std::function<bool(const QJsonValue &)> &callback, bool *stop)
+{
+    // Wrapped in an array so that scalars are valid documents too
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson('[' + element + ']', &error);
+    if (error.error != QJsonParseError::NoError || doc.array().size() != 1) {
+        qCWarning(CUTELYST_REQUEST) << "Failed to parse JSON array element:" << error.errorString();
+        return false;
+    }
+
+    *stop = !callback(doc.array().at(0));
+    return true;
+}
+
+bool RequestPrivate::readJsonArray(QIODevice *body, qint64 maxSize, const std::function<bool(const QJsonValue &)> &callback)
+{
+    enum State {
+        BeforeArray,
+        BeforeElement,
+        InElement,
+        AfterArray
+    } state = BeforeArray;
+
+    QByteArray element;
+    // Nesting depth inside the current element
+    int depth = 0;
+    bool afterComma = false;
+    bool inString = false;
+    bool escaped = false;
+
+    char buf[16 * 1024];
+    qint64 len;
+    while ((len = body->read(buf, sizeof(buf))) > 0) {
+        // Start of the current element data in this chunk
+        qint64 from = state == InElement ? 0 : -1;
+        for (qint64 i = 0; i < len; ++i) {
+            const char c = buf[i];
+            if (state != InElement) {
+                if (isJsonSpace(c)) {
+                    continue;
+                } else if (state == BeforeArray && c == '[') {
+                    state = BeforeElement;
+                    continue;
+                } else if (state == BeforeElement && c == ']' && !afterComma) {
+                    // Empty array
+                    state = AfterArray;
+                    continue;
+                } else if (state != BeforeElement) {
+                    qCWarning(CUTELYST_REQUEST) << "JSON body is not a valid array";
+                    return false;
+                }
+                state = InElement;
+                from = i;
+            }
+
+            if (inString) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    inString = false;
+                }
+                continue;
+            }
+
+            if (c == '"') {
+                inString = true;
+            } else if (c == '[' || c == '{') {
+                ++depth;
+            } else if ((c == ']' || c == '}') && depth) {
+                --depth;
+            } else if (depth == 0 && (c == ',' || c == ']')) {
+                element.append(buf + from, int(i - from));
+                if (maxSize && element.size() > maxSize) {
+                    qCWarning(CUTELYST_REQUEST) << "JSON array element is larger than" << maxSize << "bytes";
+                    return false;
+                }
+
+                bool stop;
+                if (!emitJsonElement(element, callback, &stop)) {
+                    return false;
+                }
+                if (stop) {
+                    return true;
+                }
+
+                element.clear();
+                from = -1;
+                afterComma = c == ',';
+                state = afterComma ? BeforeElement : AfterArray;
+            }
+        }
+
+        if (from != -1) {
+            element.append(buf + from, int(len - from));
+            if (maxSize && element.size() > maxSize) {
+                qCWarning(CUTELYST_REQUEST) << "JSON array element is larger than" << maxSize << "bytes";
+                return false;
+            }
+        }
+    }
+
+    return state == AfterArray;
+}
+
+QByteArray RequestPrivate::readBody(qint64 maxSize, bool *tooLarge) const
+{
+    QByteArray data;
+    *tooLarge = maxSize && !body->isSequential() && body->size() > maxSize;
+    if (!*tooLarge) {
+        auto buffer = qobject_cast<QBuffer *>(body);
+        if (buffer) {
+            // Shares the buffer data, no copy is made
+            data = buffer->data();
+        } else {
+            if (body->pos()) {
+                body->seek(0);
+            }
+
+            if (maxSize && body->isSequential()) {
+                // The size is unknown, read in blocks so the limit bounds the memory used
+                char block[16 * 1024];
+                qint64 len;
+                while ((len = body->read(block, sizeof(block))) > 0) {
+                    if (data.size() + len > maxSize) {
+                        *tooLarge = true;
+                        return QByteArray();
+                    }
+                    data.append(block, int(len));
+                }
+            } else {
+                data = body->readAll();
+            }
+        }
+        *tooLarge = maxSize && data.size() > maxSize;
+    }
+    return data;
+}
+
 static inline bool isSlit(QChar c)
 {
     return c == QLatin1Char(';') || c == QLatin1Char(',');
@@ -495,9 +709,8 @@ static int nextNonWhitespace(const QString &text, int from, int length)
     return text.length();
 }
 
-static std::pair<QString, QString> nextField(const QString &text, int &position)
+static bool nextField(const QString &text, int &position, QStringRef &name, QStringRef &value)
 {
-    std::pair<QString, QString> ret;
     // format is one of:
     //    (1)  token
     //    (2)  token = token
@@ -511,17 +724,15 @@ static std::pair<QString, QString> nextField(const QString &text, int &position)
 
     int equalsPosition = text.indexOf(QLatin1Char('='), position);
     if (equalsPosition < 0 || equalsPosition > semiColonPosition) {
-        return ret; //'=' is required for name-value-pair (RFC6265 section 5.2, rule 2)
+        return false; //'=' is required for name-value-pair (RFC6265 section 5.2, rule 2)
     }
 
-    ret.first = text.mid(position, equalsPosition - position).trimmed();
-    int secondLength = semiColonPosition - equalsPosition - 1;
-    if (secondLength > 0) {
-        ret.second = text.mid(equalsPosition + 1, secondLength).trimmed();
-    }
+    // References the header so nothing is copied until a cookie is returned
+    name = text.midRef(position, equalsPosition - position).trimmed();
+    value = text.midRef(equalsPosition + 1, semiColonPosition - equalsPosition - 1).trimmed();
 
     position = semiColonPosition;
-    return ret;
+    return !name.isEmpty();
 }
 
 void RequestPrivate::parseCookies() const
@@ -530,19 +741,18 @@ void RequestPrivate::parseCookies() const
     const QString cookieString = headers.header(QStringLiteral("COOKIE"));
     int position = 0;
     const int length = cookieString.length();
+    QStringRef name;
+    QStringRef value;
     while (position < length) {
-        const auto field = nextField(cookieString, position);
-        if (field.first.isEmpty()) {
+        if (!nextField(cookieString, position, name, value)) {
             // parsing error
             break;
         }
 
         // Some foreign cookies are not in name=value format, so ignore them.
-        if (field.second.isEmpty()) {
-            ++position;
-            continue;
+        if (!value.isEmpty()) {
+            ret.push_back({ name.toString(), value.toString() });
         }
-        ret.push_back(field);
         ++position;
     }
 
@@ -556,39 +766,101 @@ void RequestPrivate::parseCookies() const
     parserStatus |= RequestPrivate::CookiesParsed;
 }
 
-ParamsMultiMap RequestPrivate::parseUrlEncoded(const QByteArray &line)
+QString RequestPrivate::findCookie(const QString &cookieName) const
 {
-    ParamsMultiMap ret;
-    int from = line.length();
-    int pos = from;
-
-    while (pos > 0) {
-        from = pos - 1;
-        pos = line.lastIndexOf('&', from);
-
-        int len = from - pos;
-        if (len == 0) {
-            // Skip empty strings
-            --from;
-            continue;
+    const QString cookieString = headers.header(QStringLiteral("COOKIE"));
+    int position = 0;
+    const int length = cookieString.length();
+    QStringRef name;
+    QStringRef value;
+    while (position < length) {
+        if (!nextField(cookieString, position, name, value)) {
+            break;
         }
 
-        QByteArray data = line.mid(pos + 1, len);
+        if (!value.isEmpty() && name == cookieName) {
+            return value.toString();
+        }
+        ++position;
+    }
+    return QString();
+}
+
+ParamsMultiMap RequestPrivate::parseUrlEncoded(const char *data, int len, int maxFields)
+{
+    // Fields are decoded in a flat array kept on the stack for common forms
+    QVarLengthArray<QPair<QString, QString>, 64> fields;
+    int from = 0;
+    while (from < len) {
+        auto amp = static_cast<const char *>(memchr(data + from, '&', len - from));
+        const int to = amp ? amp - data : len;
+        // Skip empty strings
+        if (to != from) {
+            if (maxFields && fields.size() == maxFields) {
+                qCWarning(CUTELYST_REQUEST) << "Url-encoded data has more than" << maxFields << "fields, ignoring the remaining";
+                break;
+            }
 
-        int equal = data.indexOf('=');
-        if (equal != -1) {
-            QByteArray value = data.mid(equal + 1);
-            if (value.length()) {
-                QByteArray key = data.mid(0, equal);
-                ret.insertMulti(Utils::decodePercentEncoding(&key),
-                                Utils::decodePercentEncoding(&value));
+            const char *field = data + from;
+            const int size = to - from;
+            auto equal = static_cast<const char *>(memchr(field, '=', size));
+            if (equal) {
+                const int keySize = equal - field;
+                if (keySize + 1 < size) {
+                    fields.append(qMakePair(Utils::decodePercentEncoding(field, keySize),
+                                            Utils::decodePercentEncoding(equal + 1, size - keySize - 1)));
+                }
+            } else {
+                fields.append(qMakePair(Utils::decodePercentEncoding(field, size), QString()));
             }
+        }
+        from = to + 1;
+    }
+
+    std::stable_sort(fields.begin(), fields.end(), [] (const QPair<QString, QString> &a, const QPair<QString, QString> &b) {
+        return a.first < b.first;
+    });
+    return sortedFieldsToMap(fields.constData(), fields.size());
+}
+
+ParamsMultiMap RequestPrivate::mergeParams(const ParamsMultiMap &query, const ParamsMultiMap &body)
+{
+    // Same order as QMap::unite(), body values come first
+    QVector<QPair<QString, QString>> fields;
+    fields.reserve(query.size() + body.size());
+
+    auto queryIt = query.constBegin();
+    auto bodyIt = body.constBegin();
+    while (queryIt != query.constEnd() && bodyIt != body.constEnd()) {
+        if (queryIt.key() < bodyIt.key()) {
+            fields.append(qMakePair(queryIt.key(), queryIt.value()));
+            ++queryIt;
         } else {
-            ret.insertMulti(Utils::decodePercentEncoding(&data),
-                            QString());
+            fields.append(qMakePair(bodyIt.key(), bodyIt.value()));
+            ++bodyIt;
         }
     }
+    while (queryIt != query.constEnd()) {
+        fields.append(qMakePair(queryIt.key(), queryIt.value()));
+        ++queryIt;
+    }
+    while (bodyIt != body.constEnd()) {
+        fields.append(qMakePair(bodyIt.key(), bodyIt.value()));
+        ++bodyIt;
+    }
+
+    return sortedFieldsToMap(fields.constData(), fields.size());
+}
 
+ParamsMultiMap RequestPrivate::sortedFieldsToMap(const QPair<QString, QString> *fields, int size)
+{
+    // Inserting at the begin from the last field avoids descending the tree,
+    // insertMulti() places equal keys before the existing ones keeping their order
+    ParamsMultiMap ret;
+    while (size > 0) {
+        --size;
+        ret.insertMulti(ret.constBegin(), fields[size].first, fields[size].second);
+    }
     return ret;
 }
 
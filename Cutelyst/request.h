@@ -22,6 +22,9 @@
 
 #include <QtCore/qobject.h>
 #include <QtCore/qstringlist.h>
+#include <QtCore/qjsonvalue.h>
+
+#include <functional>
 
 #include <Cutelyst/cutelyst_global.h>
 #include <Cutelyst/paramsmultimap.h>
@@ -206,6 +209,18 @@ public:
      */
     QVariant bodyData() const;
 
+    /**
+     * Reads a JSON body whose top level value is an array one element at a time,
+     * \p callback is called with each element as soon as it is complete, so large
+     * bodies are never held in memory as a whole, return false from it to stop reading.
+     *
+     * Each element is limited by the \b json_max_size option of the
+     * \b Cutelyst_Request config section, see Engine::setConfig().
+     *
+     * Returns false if the body is not a valid JSON array.
+     */
+    bool readJsonArray(const std::function<bool(const QJsonValue &)> &callback);
+
     /**
      * Returns a QVariantMap of body (POST) parameters, this method
      * is expensive as it creates the map each time it's called, cache
@@ -330,12 +345,14 @@ public:
     inline QString contentType() const;
 
     /**
-     * Returns the cookie with the given name
+     * Returns the first cookie with the given name, the Cookie header is
+     * scanned for it unless cookies() was already called.
      */
     QString cookie(const QString &name) const;
 
     /**
-     * Returns all the cookies from the request
+     * Returns all the cookies from the request, the Cookie header is parsed
+     * on the first call.
      */
     QMap<QString, QString> cookies() const;
 
@@ -447,6 +464,19 @@ public:
      */
     QUrl uriWith(const ParamsMultiMap &args, bool append = false) const;
 
+    /**
+     * When enabled, WebSocket text and binary messages are only delivered through
+     * webSocketTextFrame() and webSocketBinaryFrame() as their data arrives, possibly
+     * several times per frame, and are no longer kept in memory to be reassembled.
+     * Such messages are not limited by the engine's maximum message size, and
+     * webSocketTextMessage() and webSocketBinaryMessage() are not emitted for them.
+     *
+     * Compressed messages are still reassembled and delivered as a single frame.
+     * This must be set right after the handshake, it's disabled by default.
+     */
+    void setWebSocketStreaming(bool enable);
+    bool webSocketStreaming() const;
+
     /**
      * Returns the current Engine processing the requests.
      */
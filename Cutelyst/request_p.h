@@ -52,8 +52,13 @@ public:
     inline void parseUrlQuery() const;
     inline void parseBody() const;
     inline void parseCookies() const;
+    inline QString findCookie(const QString &cookieName) const;
+    inline QByteArray readBody(qint64 maxSize, bool *tooLarge) const;
 
-    static inline ParamsMultiMap parseUrlEncoded(const QByteArray &line);
+    static bool readJsonArray(QIODevice *body, qint64 maxSize, const std::function<bool(const QJsonValue &)> &callback);
+    static inline ParamsMultiMap parseUrlEncoded(const char *data, int len, int maxFields);
+    static inline ParamsMultiMap mergeParams(const ParamsMultiMap &query, const ParamsMultiMap &body);
+    static inline ParamsMultiMap sortedFieldsToMap(const QPair<QString, QString> *fields, int size);
     static inline QVariantMap paramsMultiMapToVariantMap(const ParamsMultiMap &params);
 
     // Manually filled by the Engine
@@ -93,6 +98,7 @@ public:
 
     quint16 remotePort;
     bool https = false;
+    bool webSocketStreaming = false;
 };
 
 }
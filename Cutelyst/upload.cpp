@@ -25,8 +25,68 @@
 #include <QFileInfo>
 #include <QTemporaryFile>
 
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using namespace Cutelyst;
 
+#ifdef Q_OS_UNIX
+// The permissions QFile gives new files, 0666 without the umask bits
+static QFileDevice::Permissions defaultFilePermissions()
+{
+    static const QFileDevice::Permissions permissions = [] {
+        // umask() can only be read by changing it, which would race with
+        // other threads creating files, so without /proc assume the usual 022
+        mode_t mask = 022;
+#ifdef Q_OS_LINUX
+        bool found = false;
+        QFile status(QStringLiteral("/proc/self/status"));
+        if (status.open(QIODevice::ReadOnly)) {
+            const QList<QByteArray> lines = status.readAll().split('\n');
+            for (const QByteArray &line : lines) {
+                if (line.startsWith("Umask:")) {
+                    const mode_t value = static_cast<mode_t>(line.mid(6).trimmed().toUInt(&found, 8));
+                    if (found) {
+                        mask = value;
+                    }
+                    break;
+                }
+            }
+        }
+#endif
+
+        const mode_t mode = 0666 & ~mask;
+        QFileDevice::Permissions ret;
+        if (mode & S_IRUSR) {
+            ret |= QFileDevice::ReadOwner | QFileDevice::ReadUser;
+        }
+        if (mode & S_IWUSR) {
+            ret |= QFileDevice::WriteOwner | QFileDevice::WriteUser;
+        }
+        if (mode & S_IRGRP) {
+            ret |= QFileDevice::ReadGroup;
+        }
+        if (mode & S_IWGRP) {
+            ret |= QFileDevice::WriteGroup;
+        }
+        if (mode & S_IROTH) {
+            ret |= QFileDevice::ReadOther;
+        }
+        if (mode & S_IWOTH) {
+            ret |= QFileDevice::WriteOther;
+        }
+        return ret;
+    }();
+    return permissions;
+}
+#endif
+
 QString Upload::filename() const
 {
     Q_D(const Upload);
@@ -49,6 +109,10 @@ bool Upload::save(const QString &newName)
 {
     Q_D(Upload);
 
+    if (d->moveFile(newName)) {
+        return true;
+    }
+
     bool error = false;
     QString fileTemplate = QStringLiteral("%1/qt_temp.XXXXXX");
     QFile out(fileTemplate.arg(QFileInfo(newName).path()));
@@ -61,22 +125,10 @@ bool Upload::save(const QString &newName)
         setErrorString(QLatin1String("Failed to open file for saving: ") + out.errorString());
         qCWarning(CUTELYST_UPLOAD) << errorString();
     } else {
-        qint64 posOrig = d->pos;
-        seek(0);
-
-        char block[4096];
-        qint64 totalRead = 0;
-        while (!atEnd()) {
-            qint64 in = read(block, sizeof(block));
-            if (in <= 0)
-                break;
-            totalRead += in;
-            if (in != out.write(block, in)) {
-                setErrorString(QStringLiteral("Failure to write block"));
-                qCWarning(CUTELYST_UPLOAD) << errorString();
-                error = true;
-                break;
-            }
+        if (!d->copyTo(&out)) {
+            setErrorString(QStringLiteral("Failure to write block"));
+            qCWarning(CUTELYST_UPLOAD) << errorString();
+            error = true;
         }
 
         if (error) {
@@ -91,7 +143,6 @@ bool Upload::save(const QString &newName)
         if (error) {
             out.remove();
         }
-        seek(posOrig);
     }
 
     return !error;
@@ -109,30 +160,12 @@ QTemporaryFile *Upload::createTemporaryFile(const QString &templateName)
     }
 
     if (ret->open()) {
-        bool error = false;
-        qint64 posOrig = d->pos;
-        seek(0);
-
-        char block[4096];
-        qint64 totalRead = 0;
-        while (!atEnd()) {
-            qint64 in = read(block, sizeof(block));
-            if (in <= 0)
-                break;
-            totalRead += in;
-            if (in != ret->write(block, in)) {
-                setErrorString(QStringLiteral("Failure to write block"));
-                qCWarning(CUTELYST_UPLOAD) << errorString();
-                error = true;
-                break;
-            }
-        }
-
-        if (error) {
+        if (!d->copyTo(ret)) {
+            setErrorString(QStringLiteral("Failure to write block"));
+            qCWarning(CUTELYST_UPLOAD) << errorString();
             ret->remove();
         }
         ret->seek(0);
-        seek(posOrig);
 
         return ret;
     } else {
@@ -173,6 +206,7 @@ Upload::Upload(UploadPrivate *prv) :
     d_ptr(prv)
 {
     Q_D(Upload);
+    d->q_ptr = this;
     open(prv->device->openMode());
     const QString disposition = prv->headers.contentDisposition();
     int start = disposition.indexOf(QLatin1String("name=\""));
@@ -236,4 +270,84 @@ qint64 Upload::writeData(const char *data, qint64 maxSize)
     return -1;
 }
 
+bool UploadPrivate::moveFile(const QString &newName)
+{
+    // Only a part streamed to its own temporary file can be moved,
+    // and only once as later saves must still find the data
+    auto temp = qobject_cast<QTemporaryFile *>(device);
+    if (!temp || device->parent() != q_ptr || moved) {
+        return false;
+    }
+
+    temp->flush();
+    if (!temp->rename(newName)) {
+        // Most likely on a different file system
+        return false;
+    }
+    temp->setAutoRemove(false);
+    moved = true;
+
+#ifdef Q_OS_UNIX
+    // Temporary files are private, saved ones get the usual permissions
+    temp->setPermissions(defaultFilePermissions());
+#endif
+
+    // rename() closes the file, later reads and saves need it open
+    if (!device->open(QIODevice::ReadOnly)) {
+        qCWarning(CUTELYST_UPLOAD) << "Failed to reopen moved upload" << newName << device->errorString();
+    }
+
+    return true;
+}
+
+bool UploadPrivate::copyTo(QFileDevice *out)
+{
+    const qint64 size = endOffset - startOffset;
+    qint64 done = 0;
+
+#if defined(Q_OS_LINUX) && defined(SYS_copy_file_range)
+    // Let the kernel copy between files, reflinking where the file system supports it
+    auto in = qobject_cast<QFileDevice *>(device);
+    if (in && in->handle() != -1 && out->handle() != -1 && in->flush() && out->flush()) {
+        loff_t offIn = startOffset;
+        loff_t offOut = out->pos();
+        while (done < size) {
+            const long ret = syscall(SYS_copy_file_range, in->handle(), &offIn, out->handle(), &offOut, size_t(size - done), 0u);
+            if (ret <= 0) {
+                // Not supported between these files, copy the rest below
+                break;
+            }
+            done += ret;
+        }
+        out->seek(offOut);
+
+        if (done == size) {
+            return true;
+        }
+    }
+#endif
+
+    const qint64 posOrig = device->pos();
+    if (!device->seek(startOffset + done)) {
+        return false;
+    }
+
+    // Large blocks keep the number of system calls low for big uploads
+    const qint64 blockSize = qBound<qint64>(1, size - done, 256 * 1024);
+    QByteArray block(int(blockSize), Qt::Uninitialized);
+
+    bool ret = true;
+    while (done < size) {
+        const qint64 len = device->read(block.data(), qMin(blockSize, size - done));
+        if (len <= 0 || out->write(block.constData(), len) != len) {
+            ret = false;
+            break;
+        }
+        done += len;
+    }
+
+    device->seek(posOrig);
+    return ret;
+}
+
 #include "moc_upload.cpp"
@@ -24,6 +24,8 @@
 
 #include <QMultiHash>
 
+class QFileDevice;
+
 namespace Cutelyst {
 
 class UploadPrivate
@@ -35,6 +37,9 @@ public:
       , endOffset(endOffst)
     { }
 
+    bool moveFile(const QString &newName);
+    bool copyTo(QFileDevice *out);
+
     Headers headers;
     QString name;
     QString filename;
@@ -42,6 +47,9 @@ public:
     qint64 startOffset = 0;
     qint64 endOffset = 0;
     qint64 pos = 0;
+    Upload *q_ptr = nullptr;
+    // Set once the device file was moved by save()
+    bool moved = false;
 };
 
 }
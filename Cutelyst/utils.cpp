@@ -21,6 +21,9 @@
 
 #include <QTextStream>
 #include <QVector>
+#include <QVarLengthArray>
+
+#include <string.h>
 
 using namespace Cutelyst;
 
@@ -200,3 +203,135 @@ QString Utils::decodePercentEncoding(QByteArray *ba)
 
     return QString::fromUtf8(*ba);
 }
+
+static inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// memchr() is vectorized by the C library, so scan for each character separately,
+// the next '%' is remembered so a run of '+' doesn't rescan the rest of the input
+static inline const char *findEncoded(const char *from, const char *end, const char *&percent)
+{
+    if (percent < from) {
+        percent = static_cast<const char *>(memchr(from, '%', end - from));
+        if (!percent) {
+            percent = end;
+        }
+    }
+
+    auto plus = static_cast<const char *>(memchr(from, '+', percent - from));
+    return plus ? plus : percent;
+}
+
+QString Utils::decodePercentEncoding(const char *data, int len)
+{
+    const char *end = data + len;
+    auto percent = static_cast<const char *>(memchr(data, '%', len));
+    if (!percent) {
+        percent = end;
+    }
+    const char *pos = findEncoded(data, end, percent);
+    if (pos == end) {
+        return QString::fromUtf8(data, len);
+    }
+
+    // The decoded data is never larger than the input
+    QVarLengthArray<char, 512> buffer(len);
+    char *out = buffer.data();
+    const char *from = data;
+    while (pos != end) {
+        memcpy(out, from, pos - from);
+        out += pos - from;
+
+        if (*pos == '+') {
+            *out++ = ' ';
+            from = pos + 1;
+        } else {
+            const int a = pos + 2 < end ? hexValue(pos[1]) : -1;
+            const int b = a != -1 ? hexValue(pos[2]) : -1;
+            if (b != -1) {
+                *out++ = char((a << 4) | b);
+                from = pos + 3;
+            } else {
+                // Not an escape sequence, keep it as is
+                *out++ = '%';
+                from = pos + 1;
+            }
+        }
+        pos = findEncoded(from, end, percent);
+    }
+    memcpy(out, from, end - from);
+    out += end - from;
+
+    return QString::fromUtf8(buffer.constData(), out - buffer.constData());
+}
+
+static inline void writeTwoDigits(char *out, unsigned value)
+{
+    out[0] = char('0' + value / 10);
+    out[1] = char('0' + value % 10);
+}
+
+void Utils::formatHttpDate(qint64 secsSinceEpoch, char *buffer)
+{
+    // 1970-01-01 was a Thursday
+    static const char weekDays[] = "ThuFriSatSunMonTueWed";
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    qint64 days = secsSinceEpoch / 86400;
+    int secs = int(secsSinceEpoch % 86400);
+    if (secs < 0) {
+        secs += 86400;
+        --days;
+    }
+
+    // Civil date from the days since the epoch on the proleptic Gregorian calendar,
+    // eras of 400 years starting on March 1st so the leap day is the last of the year
+    const qint64 z = days + 719468;
+    const qint64 era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned dayOfEra = unsigned(z - era * 146097);
+    const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned monthFromMarch = (5 * dayOfYear + 2) / 153;
+    const unsigned day = dayOfYear - (153 * monthFromMarch + 2) / 5 + 1;
+    const unsigned month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+    const qint64 year = qBound(Q_INT64_C(0), qint64(yearOfEra) + era * 400 + (month <= 2), Q_INT64_C(9999));
+
+    const int weekDay = int(((days % 7) + 7) % 7);
+    memcpy(buffer, weekDays + weekDay * 3, 3);
+    buffer[3] = ',';
+    buffer[4] = ' ';
+    writeTwoDigits(buffer + 5, day);
+    buffer[7] = ' ';
+    memcpy(buffer + 8, months + (month - 1) * 3, 3);
+    buffer[11] = ' ';
+    writeTwoDigits(buffer + 12, unsigned(year / 100));
+    writeTwoDigits(buffer + 14, unsigned(year % 100));
+    buffer[16] = ' ';
+    writeTwoDigits(buffer + 17, unsigned(secs / 3600));
+    buffer[19] = ':';
+    writeTwoDigits(buffer + 20, unsigned(secs / 60 % 60));
+    buffer[22] = ':';
+    writeTwoDigits(buffer + 23, unsigned(secs % 60));
+    memcpy(buffer + 25, " GMT", 4);
+}
+
+QString Utils::httpDate(const QDateTime &dateTime)
+{
+    qint64 msecs = dateTime.toMSecsSinceEpoch();
+    if (msecs < 0) {
+        msecs -= 999;
+    }
+
+    char buffer[29];
+    formatHttpDate(msecs / 1000, buffer);
+    return QString::fromLatin1(buffer, sizeof(buffer));
+}
@@ -21,6 +21,7 @@
 #define UTILS_H
 
 #include <QtCore/QStringList>
+#include <QtCore/QDateTime>
 
 #include <Cutelyst/cutelyst_global.h>
 
@@ -32,6 +33,25 @@ namespace Utils {
     CUTELYST_LIBRARY QString decodePercentEncoding(QString *s);
 
     CUTELYST_LIBRARY QString decodePercentEncoding(QByteArray *ba);
+
+    /**
+     * Decodes the \p len bytes at \p data without modifying them, '+' becomes a space and
+     * valid %XX escapes their byte. Unlike decodePercentEncoding(QByteArray*), a '%' not
+     * followed by two hex digits is kept as is. Runs without '%' or '+' are converted
+     * straight from the input.
+     */
+    CUTELYST_LIBRARY QString decodePercentEncoding(const char *data, int len);
+
+    /**
+     * Writes the RFC 7231 date of \p secsSinceEpoch, e.g. "Sun, 06 Nov 1994 08:49:37 GMT",
+     * to the 29 bytes at \p buffer, neither the locale nor the time zone database are used.
+     */
+    CUTELYST_LIBRARY void formatHttpDate(qint64 secsSinceEpoch, char *buffer);
+
+    /**
+     * Returns the RFC 7231 date of \p dateTime, as used by the Date and Last-Modified headers.
+     */
+    CUTELYST_LIBRARY QString httpDate(const QDateTime &dateTime);
 }
 
 }
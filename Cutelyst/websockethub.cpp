@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include "websockethub_p.h"
+
+#include "common.h"
+
+#include <Cutelyst/Context>
+#include <Cutelyst/Engine>
+#include <Cutelyst/Response>
+
+using namespace Cutelyst;
+
+WebSocketHub::WebSocketHub(QObject *parent) : QObject(parent)
+  , d_ptr(new WebSocketHubPrivate)
+{
+    d_ptr->q_ptr = this;
+}
+
+WebSocketHub::~WebSocketHub()
+{
+    delete d_ptr;
+}
+
+void WebSocketHub::subscribe(Context *c, const QString &topic)
+{
+    Q_D(WebSocketHub);
+
+    auto it = d->subscriptions.find(c);
+    if (it == d->subscriptions.end()) {
+        it = d->subscriptions.insert(c, QStringList());
+        connect(c, &QObject::destroyed, this, [d, c] {
+            d->removeSubscriber(c);
+        });
+    } else if (it->contains(topic)) {
+        return;
+    }
+
+    it->append(topic);
+    d->topics[topic].append(c);
+}
+
+void WebSocketHub::unsubscribe(Context *c, const QString &topic)
+{
+    Q_D(WebSocketHub);
+
+    auto it = d->subscriptions.find(c);
+    if (it == d->subscriptions.end() || !it->removeOne(topic)) {
+        return;
+    }
+
+    if (it->isEmpty()) {
+        d->subscriptions.erase(it);
+        disconnect(c, &QObject::destroyed, this, nullptr);
+    }
+
+    auto topicIt = d->topics.find(topic);
+    if (topicIt != d->topics.end()) {
+        topicIt->removeOne(c);
+        if (topicIt->isEmpty()) {
+            d->topics.erase(topicIt);
+        }
+    }
+}
+
+void WebSocketHub::unsubscribeAll(Context *c)
+{
+    Q_D(WebSocketHub);
+    if (d->subscriptions.contains(c)) {
+        disconnect(c, &QObject::destroyed, this, nullptr);
+        d->removeSubscriber(c);
+    }
+}
+
+QStringList WebSocketHub::topics() const
+{
+    Q_D(const WebSocketHub);
+    return d->topics.keys();
+}
+
+int WebSocketHub::subscriberCount(const QString &topic) const
+{
+    Q_D(const WebSocketHub);
+    return d->topics.value(topic).size();
+}
+
+int WebSocketHub::publishTextMessage(const QString &topic, const QString &message)
+{
+    Q_D(WebSocketHub);
+    if (!d->topics.contains(topic)) {
+        return 0;
+    }
+    return d->publish(topic, message.toUtf8(), false);
+}
+
+int WebSocketHub::publishBinaryMessage(const QString &topic, const QByteArray &message)
+{
+    Q_D(WebSocketHub);
+    if (!d->topics.contains(topic)) {
+        return 0;
+    }
+    return d->publish(topic, message, true);
+}
+
+void WebSocketHub::setMaxPendingBytes(qint64 bytes)
+{
+    Q_D(WebSocketHub);
+    d->maxPendingBytes = bytes;
+}
+
+qint64 WebSocketHub::maxPendingBytes() const
+{
+    Q_D(const WebSocketHub);
+    return d->maxPendingBytes;
+}
+
+void WebSocketHub::setOverflowPolicy(OverflowPolicy policy)
+{
+    Q_D(WebSocketHub);
+    d->overflowPolicy = policy;
+}
+
+WebSocketHub::OverflowPolicy WebSocketHub::overflowPolicy() const
+{
+    Q_D(const WebSocketHub);
+    return d->overflowPolicy;
+}
+
+int WebSocketHubPrivate::publish(const QString &topic, const QByteArray &payload, bool binary)
+{
+    Q_Q(WebSocketHub);
+
+    // A copy as closing a connection might change the subscribers
+    const QVector<Context *> subscribers = topics.value(topic);
+
+    int sent = 0;
+    Engine *frameEngine = nullptr;
+    QByteArray frame;
+    for (Context *c : subscribers) {
+        if (!subscriptions.contains(c)) {
+            continue;
+        }
+
+        // The frame is built once and shared by all connections
+        Engine *engine = c->engine();
+        if (engine != frameEngine) {
+            frameEngine = engine;
+            frame = engine->webSocketPrepareMessage(payload, binary);
+        }
+
+        if (frame.isEmpty()) {
+            continue;
+        }
+
+        if (maxPendingBytes > 0 && engine->webSocketBytesToWrite(c) > maxPendingBytes) {
+            qCDebug(CUTELYST_CORE) << "Dropping message to slow WebSocket subscriber of" << topic;
+            Q_EMIT q->messageDropped(c, topic);
+            if (overflowPolicy == WebSocketHub::CloseConnection) {
+                engine->webSocketClose(c, Response::CloseCodePolicyViolated, QStringLiteral("too slow"));
+                removeSubscriber(c);
+            }
+            continue;
+        }
+
+        if (engine->webSocketSendFrame(c, frame)) {
+            ++sent;
+        }
+    }
+
+    return sent;
+}
+
+void WebSocketHubPrivate::removeSubscriber(Context *c)
+{
+    const QStringList subscribed = subscriptions.take(c);
+    for (const QString &topic : subscribed) {
+        auto it = topics.find(topic);
+        if (it != topics.end()) {
+            it->removeOne(c);
+            if (it->isEmpty()) {
+                topics.erase(it);
+            }
+        }
+    }
+}
+
+#include "moc_websockethub.cpp"
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef CUTELYST_WEBSOCKETHUB_H
+#define CUTELYST_WEBSOCKETHUB_H
+
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+
+#include <Cutelyst/cutelyst_global.h>
+
+namespace Cutelyst {
+
+class Context;
+class WebSocketHubPrivate;
+/**
+ * The WebSocketHub class delivers messages to the WebSocket connections
+ * subscribed to a topic.
+ *
+ * A published message is encoded and framed only once, all subscribers
+ * then get the same implicitly shared frame. Connections are removed from
+ * their topics when their Context is destroyed.
+ *
+ * Each worker has its own Application and connections, so a hub should be
+ * created per Application, e.g. on a controller, and only used from its
+ * thread.
+ */
+class CUTELYST_LIBRARY WebSocketHub : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(WebSocketHub)
+public:
+    /**
+     * What happens to a subscriber that has more than maxPendingBytes()
+     * waiting to be written when a message is published
+     */
+    enum OverflowPolicy {
+        DropMessage,
+        CloseConnection
+    };
+    Q_ENUM(OverflowPolicy)
+
+    /**
+     * Constructs a WebSocketHub object with the given \p parent.
+     */
+    explicit WebSocketHub(QObject *parent = nullptr);
+    virtual ~WebSocketHub();
+
+    /**
+     * Subscribes the WebSocket connection of \p c to \p topic,
+     * the WebSocket handshake must have been done already.
+     */
+    void subscribe(Context *c, const QString &topic);
+
+    /**
+     * Removes the subscription of \p c to \p topic
+     */
+    void unsubscribe(Context *c, const QString &topic);
+
+    /**
+     * Removes all subscriptions of \p c
+     */
+    void unsubscribeAll(Context *c);
+
+    /**
+     * Returns the topics that have at least one subscriber
+     */
+    QStringList topics() const;
+
+    /**
+     * Returns the number of connections subscribed to \p topic
+     */
+    int subscriberCount(const QString &topic) const;
+
+    /**
+     * Sends a text \p message to all subscribers of \p topic,
+     * returns the number of connections it was written to.
+     */
+    int publishTextMessage(const QString &topic, const QString &message);
+
+    /**
+     * Sends a binary \p message to all subscribers of \p topic,
+     * returns the number of connections it was written to.
+     */
+    int publishBinaryMessage(const QString &topic, const QByteArray &message);
+
+    /**
+     * Defines the number of bytes a subscriber may have waiting to be written
+     * before overflowPolicy() applies to it, 0 (the default) means no limit.
+     */
+    void setMaxPendingBytes(qint64 bytes);
+    qint64 maxPendingBytes() const;
+
+    /**
+     * Defines what happens to slow subscribers, the default is DropMessage.
+     */
+    void setOverflowPolicy(OverflowPolicy policy);
+    OverflowPolicy overflowPolicy() const;
+
+Q_SIGNALS:
+    /**
+     * Emitted when a message to \p topic wasn't sent to \p c because
+     * it had too much data waiting to be written.
+     */
+    void messageDropped(Cutelyst::Context *c, const QString &topic);
+
+protected:
+    WebSocketHubPrivate *d_ptr;
+};
+
+}
+
+#endif // CUTELYST_WEBSOCKETHUB_H
@@ -25,6 +25,8 @@ private Q_SLOTS:
         doTest();
     }
 
+    void benchmarkUriFor();
+
     void cleanupTestCase();
 
 private:
@@ -111,6 +113,21 @@ public:
         }
     }
 
+    C_ATTR(uriForLinks, :Local :AutoArgs)
+    void uriForLinks(Context *c) {
+        // A page rendering 500 links to a Path and a Chained action
+        Action *local = c->getAction(QStringLiteral("actionName"), QStringLiteral("context/test_ns"));
+        Action *chained = c->getAction(QStringLiteral("midleEnd"), QStringLiteral("test/controller"));
+        QString body;
+        for (int i = 0; i < 250; ++i) {
+            const QString id = QString::number(i);
+            body.append(c->uriFor(local, QStringList{ id }).toString(QUrl::FullyEncoded));
+            body.append(c->uriFor(chained, QStringList{ id, id }, QStringList{ id }).toString(QUrl::FullyEncoded));
+            body.append(QLatin1Char('\n'));
+        }
+        c->response()->setBody(body);
+    }
+
 private:
     C_ATTR(Begin,)
     bool Begin(Context *) { return true; }
@@ -163,6 +180,23 @@ void TestContext::doTest()
     QCOMPARE(result.value(QStringLiteral("body")).toByteArray(), output);
 }
 
+void TestContext::benchmarkUriFor()
+{
+    QVariantMap result;
+    QBENCHMARK {
+        result = m_engine->createRequest(QStringLiteral("GET"),
+                                         QStringLiteral("context/test_ns/uriForLinks"),
+                                         QByteArray(),
+                                         Headers(),
+                                         nullptr);
+    }
+
+    const QList<QByteArray> links = result.value(QStringLiteral("body")).toByteArray().split('\n');
+    QCOMPARE(links.size(), 251);
+    QCOMPARE(links.at(1), QByteArrayLiteral("http://127.0.0.1/context/test_ns/actionName/1"
+                                            "http://127.0.0.1/chain/midle/1/1/end/1"));
+}
+
 void TestContext::testController_data()
 {
     QTest::addColumn<QString>("url");
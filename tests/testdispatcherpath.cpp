@@ -10,9 +10,28 @@
 #include <Cutelyst/application.h>
 #include <Cutelyst/controller.h>
 #include <Cutelyst/headers.h>
+#include <Cutelyst/dispatcher.h>
+#include <Cutelyst/dispatchtypepath.h>
 
 using namespace Cutelyst;
 
+class BenchPathAction : public Action
+{
+    Q_OBJECT
+public:
+    BenchPathAction(const QString &path, int numberOfArgs, QObject *parent) : Action(parent)
+    {
+        QMap<QString, QString> attributes;
+        attributes.insert(QStringLiteral("Path"), path);
+        if (numberOfArgs != -1) {
+            attributes.insert(QStringLiteral("Args"), QString::number(numberOfArgs));
+        }
+        setName(path);
+        setReverse(path);
+        setupAction({ {QStringLiteral("attributes"), QVariant::fromValue(attributes)} }, nullptr);
+    }
+};
+
 class TestDispatcherPath : public CoverageObject
 {
     Q_OBJECT
@@ -25,6 +44,11 @@ private Q_SLOTS:
         doTest();
     }
 
+    void testMatchCache();
+
+    void benchmarkPathDispatch_data();
+    void benchmarkPathDispatch();
+
     void cleanupTestCase();
 
 private:
@@ -103,6 +127,76 @@ void TestDispatcherPath::testController_data()
     QTest::newRow("path-test21") << QStringLiteral("/") << QByteArrayLiteral("rootAction");
 }
 
+void TestDispatcherPath::testMatchCache()
+{
+    Dispatcher *dispatcher = m_engine->app()->dispatcher();
+    const quint64 hits = dispatcher->matchCacheHits();
+    const quint64 misses = dispatcher->matchCacheMisses();
+
+    const QByteArray output = QByteArrayLiteral("path /test/controller/two/cache/miss args cache/miss");
+    for (int i = 0; i < 3; ++i) {
+        QVariantMap result = m_engine->createRequest(QStringLiteral("GET"),
+                                                     QStringLiteral("test/controller/two/cache/miss"),
+                                                     QByteArray(),
+                                                     Headers(),
+                                                     nullptr);
+        QCOMPARE(result.value(QStringLiteral("body")).toByteArray(), output);
+    }
+
+    QCOMPARE(dispatcher->matchCacheMisses(), misses + 1);
+    QCOMPARE(dispatcher->matchCacheHits(), hits + 2);
+}
+
+void TestDispatcherPath::benchmarkPathDispatch_data()
+{
+    QTest::addColumn<bool>("tree");
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<QString>("match");
+
+    QTest::newRow("levels-root") << false << QStringLiteral("bench/ns1/action1") << QStringLiteral("bench/ns1/action1");
+    QTest::newRow("tree-root") << true << QStringLiteral("bench/ns1/action1") << QStringLiteral("bench/ns1/action1");
+    QTest::newRow("levels-args") << false << QStringLiteral("bench/ns99/action2/foo/bar") << QStringLiteral("bench/ns99/action2");
+    QTest::newRow("tree-args") << true << QStringLiteral("bench/ns99/action2/foo/bar") << QStringLiteral("bench/ns99/action2");
+    QTest::newRow("levels-deep") << false << QStringLiteral("bench/ns50/action2/a/b/c/d/e/f/g/h") << QStringLiteral("bench/ns50/action2");
+    QTest::newRow("tree-deep") << true << QStringLiteral("bench/ns50/action2/a/b/c/d/e/f/g/h") << QStringLiteral("bench/ns50/action2");
+}
+
+void TestDispatcherPath::benchmarkPathDispatch()
+{
+    QFETCH(bool, tree);
+    QFETCH(QString, path);
+    QFETCH(QString, match);
+
+    // 5000 actions: slurpy, Args(1) and Args(2)
+    DispatchTypePath dispatch;
+    for (int i = 0; i < 5000; ++i) {
+        const int numberOfArgs = (i % 3) ? (i % 3) : -1;
+        dispatch.registerAction(new BenchPathAction(QStringLiteral("/bench/ns%1/action%2").arg(i / 50).arg(i % 50),
+                                                    numberOfArgs, &dispatch));
+    }
+    QVERIFY(dispatch.inUse());
+
+    Context c(m_engine->app());
+    QBENCHMARK {
+        if (tree) {
+            dispatch.matchLongestPrefix(&c, path);
+        } else {
+            // What the Dispatcher does for unknown dispatch types
+            QString level = path;
+            QStringList args;
+            Q_FOREVER {
+                if (dispatch.match(&c, level, args) == DispatchType::ExactMatch || level.isEmpty()) {
+                    break;
+                }
+                int pos = level.lastIndexOf(QLatin1Char('/'));
+                args.prepend(level.mid(pos + 1));
+                level.resize(pos);
+            }
+        }
+    }
+    QCOMPARE(c.request()->match(), match);
+}
+
 QTEST_MAIN(TestDispatcherPath)
 
 #include "testdispatcherpath.moc"
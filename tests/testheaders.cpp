@@ -25,6 +25,7 @@
 #include <QtCore/QObject>
 
 #include "headers.h"
+#include "utils.h"
 #include "coverageobject.h"
 
 using namespace Cutelyst;
@@ -34,6 +35,9 @@ class TestHeaders : public CoverageObject
     Q_OBJECT
 private Q_SLOTS:
     void testCombining();
+
+    void testHttpDate_data();
+    void testHttpDate();
 };
 
 void TestHeaders::testCombining()
@@ -162,6 +166,39 @@ void TestHeaders::testCombining()
     QCOMPARE(headers.contentDisposition(), QStringLiteral("attachment; filename=\"foo.txt\""));
 }
 
+void TestHeaders::testHttpDate_data()
+{
+    QTest::addColumn<qint64>("secsSinceEpoch");
+    QTest::addColumn<QString>("output");
+
+    QTest::newRow("epoch") << Q_INT64_C(0) << QStringLiteral("Thu, 01 Jan 1970 00:00:00 GMT");
+    QTest::newRow("before-epoch") << Q_INT64_C(-1) << QStringLiteral("Wed, 31 Dec 1969 23:59:59 GMT");
+    QTest::newRow("rfc7231") << Q_INT64_C(784111777) << QStringLiteral("Sun, 06 Nov 1994 08:49:37 GMT");
+    QTest::newRow("leap-day") << Q_INT64_C(951782400) << QStringLiteral("Tue, 29 Feb 2000 00:00:00 GMT");
+    QTest::newRow("not-leap-century") << Q_INT64_C(4107542400) << QStringLiteral("Mon, 01 Mar 2100 00:00:00 GMT");
+    QTest::newRow("some-date") << Q_INT64_C(1500000000) << QStringLiteral("Fri, 14 Jul 2017 02:40:00 GMT");
+}
+
+void TestHeaders::testHttpDate()
+{
+    QFETCH(qint64, secsSinceEpoch);
+    QFETCH(QString, output);
+
+    char buffer[29];
+    Utils::formatHttpDate(secsSinceEpoch, buffer);
+    QCOMPARE(QString::fromLatin1(buffer, sizeof(buffer)), output);
+
+    const QDateTime dt = QDateTime::fromMSecsSinceEpoch(secsSinceEpoch * 1000, Qt::UTC);
+    QCOMPARE(Utils::httpDate(dt), output);
+    QCOMPARE(Utils::httpDate(dt.toLocalTime()), output);
+
+    Headers headers;
+    QCOMPARE(headers.setLastModified(dt), output);
+    QCOMPARE(headers.header(QStringLiteral("Last-Modified")), output);
+    QCOMPARE(headers.setDateWithDateTime(dt), output);
+    QCOMPARE(headers.date(), dt);
+}
+
 QTEST_MAIN(TestHeaders)
 #include "testheaders.moc"
 
@@ -0,0 +1,138 @@
+#ifndef MULTIPARTFORMDATAPARSERTEST_H
+#define MULTIPARTFORMDATAPARSERTEST_H
+
+#include <QTest>
+#include <QObject>
+#include <QBuffer>
+#include <QTemporaryFile>
+
+#include "coverageobject.h"
+
+#include <Cutelyst/upload.h>
+#include <Cutelyst/multipartformdataparser.h>
+
+using namespace Cutelyst;
+
+class TestMultiPartFormDataParser : public CoverageObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void testFeedChunks_data();
+    void testFeedChunks();
+    void testDelimiterSplit();
+    void testMalformed();
+
+private:
+    QByteArray m_body;
+    QByteArray m_big;
+    QString m_contentType;
+};
+
+static const int MemoryLimit = 64 * 1024;
+
+void TestMultiPartFormDataParser::initTestCase()
+{
+    m_contentType = QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH");
+
+    // Larger than the memory limit, with partial boundaries inside the data
+    while (m_big.size() <= MemoryLimit + 1024) {
+        m_big.append("0123456789\r\n------WebKitFormBoundaryoPPQ");
+    }
+
+    m_body = QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\n"
+                               "Content-Disposition: form-data; name=\"path\"\r\n\r\n"
+                               "textooooo\r\n"
+                               "------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\n"
+                               "Content-Disposition: form-data; name=\"big\"; filename=\"big.bin\"\r\n"
+                               "Content-Type: application/octet-stream\r\n\r\n")
+            + m_big
+            + QByteArrayLiteral("\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n");
+}
+
+void TestMultiPartFormDataParser::testFeedChunks_data()
+{
+    QTest::addColumn<int>("chunkSize");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("7") << 7;
+    QTest::newRow("41") << 41;
+    QTest::newRow("4096") << 4096;
+    QTest::newRow("whole") << m_body.size();
+}
+
+void TestMultiPartFormDataParser::testFeedChunks()
+{
+    QFETCH(int, chunkSize);
+
+    MultiPartFormDataParser parser(m_contentType, MemoryLimit);
+    for (int pos = 0; pos < m_body.size(); pos += chunkSize) {
+        QVERIFY(parser.feed(m_body.constData() + pos, qMin(chunkSize, m_body.size() - pos)));
+    }
+    QVERIFY(parser.atEnd());
+
+    const Uploads uploads = parser.takeUploads();
+    QCOMPARE(uploads.size(), 2);
+
+    Upload *path = uploads.at(0);
+    QCOMPARE(path->name(), QStringLiteral("path"));
+    QCOMPARE(path->readAll(), QByteArrayLiteral("textooooo"));
+    // Small parts are kept in memory
+    QVERIFY(path->findChild<QBuffer *>());
+
+    Upload *big = uploads.at(1);
+    QCOMPARE(big->name(), QStringLiteral("big"));
+    QCOMPARE(big->filename(), QStringLiteral("big.bin"));
+    QCOMPARE(big->contentType(), QStringLiteral("application/octet-stream"));
+    QCOMPARE(big->size(), qint64(m_big.size()));
+    QCOMPARE(big->readAll(), m_big);
+    // Moved to a file once it grew past the memory limit
+    QVERIFY(big->findChild<QTemporaryFile *>());
+    QVERIFY(!big->findChild<QBuffer *>());
+
+    qDeleteAll(uploads);
+}
+
+void TestMultiPartFormDataParser::testDelimiterSplit()
+{
+    // Split the body at every byte of the delimiter that closes the first part
+    const QByteArray delimiter = QByteArrayLiteral("\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH");
+    const int start = m_body.indexOf(delimiter);
+    QVERIFY(start > 0);
+
+    for (int split = start; split <= start + delimiter.size(); ++split) {
+        MultiPartFormDataParser parser(m_contentType, MemoryLimit);
+        QVERIFY(parser.feed(m_body.constData(), split));
+        QVERIFY(!parser.atEnd());
+        QVERIFY(parser.feed(m_body.constData() + split, m_body.size() - split));
+        QVERIFY(parser.atEnd());
+
+        const Uploads uploads = parser.takeUploads();
+        QCOMPARE(uploads.size(), 2);
+        QCOMPARE(uploads.at(0)->readAll(), QByteArrayLiteral("textooooo"));
+        QCOMPARE(uploads.at(1)->size(), qint64(m_big.size()));
+        qDeleteAll(uploads);
+    }
+}
+
+void TestMultiPartFormDataParser::testMalformed()
+{
+    MultiPartFormDataParser noBoundary(QStringLiteral("multipart/form-data"));
+    QVERIFY(!noBoundary.feed(m_body.constData(), m_body.size()));
+    QVERIFY(noBoundary.takeUploads().isEmpty());
+
+    const QByteArray body = QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVHxx");
+    MultiPartFormDataParser parser(m_contentType, MemoryLimit);
+    QVERIFY(!parser.feed(body.constData(), body.size()));
+    QVERIFY(!parser.atEnd());
+    // Data after an error is ignored
+    QVERIFY(!parser.feed(m_body.constData(), m_body.size()));
+    QVERIFY(parser.takeUploads().isEmpty());
+}
+
+QTEST_MAIN(TestMultiPartFormDataParser)
+
+#include "testmultipartformdataparser.moc"
+
+#endif
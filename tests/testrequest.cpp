@@ -2,6 +2,7 @@
 #define DISPATCHERTEST_H
 
 #include <QTest>
+#include <QBuffer>
 #include <QObject>
 #include <QHostInfo>
 #include <QUuid>
@@ -10,6 +11,7 @@
 #include <QJsonDocument>
 #include <QCryptographicHash>
 #include <QUrlQuery>
+#include <QTemporaryDir>
 
 #include "headers.h"
 #include "coverageobject.h"
@@ -18,6 +20,7 @@
 #include <Cutelyst/controller.h>
 #include <Cutelyst/headers.h>
 #include <Cutelyst/upload.h>
+#include <Cutelyst/multipartformdataparser.h>
 
 using namespace Cutelyst;
 
@@ -37,6 +40,9 @@ private Q_SLOTS:
         doTest();
     }
 
+    void benchmarkMultiPart_data();
+    void benchmarkMultiPart();
+
     void cleanupTestCase();
 
 private:
@@ -330,6 +336,20 @@ public:
         c->response()->setBody(c->request()->bodyData().toJsonDocument().toJson(QJsonDocument::Compact));
     }
 
+    C_ATTR(readJsonArray, :Local :AutoArgs)
+    void readJsonArray(Context *c) {
+        QByteArrayList elements;
+        const bool ok = c->request()->readJsonArray([&elements] (const QJsonValue &value) -> bool {
+            elements.append(QJsonDocument(QJsonArray{ value }).toJson(QJsonDocument::Compact));
+            return elements.size() < 3;
+        });
+        if (ok) {
+            c->response()->setBody(elements.join(';'));
+        } else {
+            c->response()->setBody(QByteArrayLiteral("invalid"));
+        }
+    }
+
     C_ATTR(uploads, :Local :AutoArgs)
     void uploads(Context *c) {
         QUrlQuery ret;
@@ -376,7 +396,26 @@ public:
         }
     }
 
+    C_ATTR(uploadSave, :Local :AutoArgs)
+    void uploadSave(Context *c, const QString &name) {
+        // Saving twice must work even when the first save moves the data
+        QTemporaryDir dir;
+        Upload *upload = c->request()->upload(name);
+        QFile first(dir.path() + QLatin1String("/first"));
+        QFile second(dir.path() + QLatin1String("/second"));
+        if (!upload || !upload->save(first.fileName()) || !upload->save(second.fileName())
+                || !first.open(QIODevice::ReadOnly) || !second.open(QIODevice::ReadOnly)) {
+            c->response()->setBody(QByteArrayLiteral("failed"));
+            return;
+        }
 
+        const QByteArray data = first.readAll();
+        if (data != second.readAll() || data != upload->readAll()) {
+            c->response()->setBody(QByteArrayLiteral("differs"));
+            return;
+        }
+        c->response()->setBody(QCryptographicHash::hash(data, QCryptographicHash::Sha256).toBase64());
+    }
 };
 
 void TestRequest::initTestCase()
@@ -390,6 +429,11 @@ TestEngine* TestRequest::getEngine()
     qputenv("RECURSION", QByteArrayLiteral("100"));
     auto app = new TestApplication;
     auto engine = new TestEngine(app, QVariantMap());
+    engine->setConfig({
+                          { QStringLiteral("Cutelyst_Request"), QVariantMap{
+                                { QStringLiteral("form_max_fields"), 100 }
+                            }}
+                      });
     new RequestTest(app);
     if (!engine->init()) {
         return nullptr;
@@ -519,6 +563,27 @@ void TestRequest::testController_data()
                                    << headers << QByteArray()
                                    << QByteArrayLiteral("S=foo%3DTGp743-6uvY:first%3DMnBbT3wcrA-uy%3DMnwcrA:bla%3D0L7g");
 
+    query.clear();
+    QTest::newRow("cookie-test02") << get << QStringLiteral("/request/test/cookie/SECOND")
+                                   << headers << QByteArray()
+                                   << QByteArrayLiteral("SECOND=AF6bahuOZFc_P7-oCw");
+
+    query.clear();
+    QTest::newRow("cookie-test03") << get << QStringLiteral("/request/test/cookie/first")
+                                   << headers << QByteArray()
+                                   << QByteArrayLiteral("");
+
+    query.clear();
+    headers.setHeader(QStringLiteral("Cookie"), QStringLiteral("empty=; dup = one ; dup=two"));
+    QTest::newRow("cookie-test04") << get << QStringLiteral("/request/test/cookie/dup")
+                                   << headers << QByteArray()
+                                   << QByteArrayLiteral("dup=one");
+
+    query.clear();
+    QTest::newRow("cookie-test05") << get << QStringLiteral("/request/test/cookie/empty")
+                                   << headers << QByteArray()
+                                   << QByteArrayLiteral("");
+
     query.clear();
     query.addQueryItem(QStringLiteral("some text to ask"), QString());
     QTest::newRow("queryKeywords-test00") << get << QStringLiteral("/request/test/queryKeywords?") + query.toString(QUrl::FullyEncoded)
@@ -769,6 +834,35 @@ void TestRequest::testController_data()
                                       << headers << query.toString(QUrl::FullyEncoded).toLatin1()
                                       << QByteArrayLiteral("foo+bar");
 
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("bodyParam-test05") << get << QStringLiteral("/request/test/bodyParam?param=x&defaultValue=SomeDefaultValue")
+                                      << headers << QByteArrayLiteral("a=1\n2&x=after+a%20newline")
+                                      << QByteArrayLiteral("after a newline");
+
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("bodyParam-test06") << get << QStringLiteral("/request/test/bodyParam?param=x&defaultValue=SomeDefaultValue")
+                                      << headers << QByteArrayLiteral("x=%zz%4")
+                                      << QByteArrayLiteral("%zz%4");
+
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("bodyParam-test07") << get << QStringLiteral("/request/test/bodyParam?param=x&defaultValue=SomeDefaultValue")
+                                      << headers << QByteArrayLiteral("&&x=%C3%A7+%E2%82%AC&&")
+                                      << QByteArrayLiteral("\xC3\xA7 \xE2\x82\xAC");
+
+    body.clear();
+    for (int i = 0; i < 101; ++i) {
+        body.append("&f" + QByteArray::number(i) + "=v" + QByteArray::number(i));
+    }
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("bodyParam-test08") << get << QStringLiteral("/request/test/bodyParam?param=f99&defaultValue=SomeDefaultValue")
+                                      << headers << body
+                                      << QByteArrayLiteral("v99");
+
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("bodyParam-test09") << get << QStringLiteral("/request/test/bodyParam?param=f100&defaultValue=SomeDefaultValue")
+                                      << headers << body
+                                      << QByteArrayLiteral("SomeDefaultValue");
+
     query.clear();
     query.addQueryItem(QStringLiteral("foo"), QStringLiteral("Cutelyst"));
     query.addQueryItem(QStringLiteral("bar"), QStringLiteral("baz"));
@@ -778,6 +872,16 @@ void TestRequest::testController_data()
                                        << headers << query.toString(QUrl::FullyEncoded).toLatin1()
                                        << QByteArrayLiteral("bar=baz&defaultValue=SomeDefaultValue&foo=Cutelyst&param=y&x");
 
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("parameters-test01") << get << QStringLiteral("/request/test/parameters?foo=q1&a=1&foo=q2")
+                                       << headers << QByteArrayLiteral("foo=b1&z=2&foo=b2")
+                                       << QByteArrayLiteral("a=1&foo=b1&foo=b2&foo=q1&foo=q2&z=2");
+
+    headers.setContentType(QStringLiteral("application/x-www-form-urlencoded"));
+    QTest::newRow("parameters-test02") << get << QStringLiteral("/request/test/paramsKey/foo?foo=q1&a=1&foo=q2")
+                                       << headers << QByteArrayLiteral("foo=b1&z=2&foo=b2")
+                                       << QByteArrayLiteral("b1/b2/q1/q2");
+
     query.clear();
     query.addQueryItem(QStringLiteral("foo"), QStringLiteral("Cutelyst"));
     query.addQueryItem(QStringLiteral("bar"), QStringLiteral("baz"));
@@ -886,6 +990,34 @@ void TestRequest::testController_data()
                                          << headers << QJsonDocument(array).toJson(QJsonDocument::Compact)
                                          << QByteArrayLiteral("[{\"foo\":\"bar\"}]");
 
+    headers.clear();
+    headers.setContentType(QStringLiteral("application/json"));
+    QTest::newRow("readJsonArray-test00") << post << QStringLiteral("/request/test/readJsonArray")
+                                          << headers << QByteArrayLiteral(" [ 1, \"a,]\\\"\" ,{\"b\":[1,{}]}\n] ")
+                                          << QByteArrayLiteral("[1];[\"a,]\\\"\"];[{\"b\":[1,{}]}]");
+
+    headers.setContentType(QStringLiteral("application/json"));
+    QTest::newRow("readJsonArray-test01") << post << QStringLiteral("/request/test/readJsonArray")
+                                          << headers << QByteArrayLiteral("[]")
+                                          << QByteArray();
+
+    headers.setContentType(QStringLiteral("application/json"));
+    QTest::newRow("readJsonArray-test02") << post << QStringLiteral("/request/test/readJsonArray")
+                                          << headers << QByteArrayLiteral("[1,]")
+                                          << QByteArrayLiteral("invalid");
+
+    headers.setContentType(QStringLiteral("application/json"));
+    QTest::newRow("readJsonArray-test03") << post << QStringLiteral("/request/test/readJsonArray")
+                                          << headers << QByteArrayLiteral("{\"foo\":[1]}")
+                                          << QByteArrayLiteral("invalid");
+
+    // Stops after the third element
+    headers.setHeader(QStringLiteral("sequential"), QStringLiteral("true"));
+    headers.setContentType(QStringLiteral("application/json"));
+    QTest::newRow("readJsonArray-test04") << post << QStringLiteral("/request/test/readJsonArray")
+                                          << headers << QByteArrayLiteral("[true,null,\"x\",4,5")
+                                          << QByteArrayLiteral("[true];[null];[\"x\"]");
+
     query.clear();
     headers.clear();
     headers.setContentType(QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH"));
@@ -899,7 +1031,26 @@ void TestRequest::testController_data()
     headers.setContentType(QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH"));
     QTest::newRow("uploads-test01") << post << QStringLiteral("/request/test/uploads")
                                     << headers << QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\ntextooooo\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"file1\"; filename=\"wifi\"\r\nContent-Type: application/octet-stream\r\n\r\nMOTOCM\nMOTOCM\n00000000\n\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"file1\"; filename=\"example.txt\"\r\nContent-Type: application/octet-stream\r\n\r\nhttps://example.com/admin\n\n\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n")
-                                    << QByteArray();
+                                    << QByteArrayLiteral("file1=file1&file1=wifi&file1=application/octet-stream&file1=23&file1=Nt4GUs/5oyPkWSe8ld+DZQWUTanILvYIjmZduHHNoFQ%3D&file1=file1&file1=example.txt&file1=application/octet-stream&file1=27&file1=NOs3g3ULsweum7JyvzfRteIeDOucGIqevQr7vs3uErw%3D&path=path&path&path&path=9&path=MM8LdQ9wbgiodipIWVkMtiYmUqojibHoUTcIlzrBZys%3D");
+
+    // Sequential upload larger than what is kept in memory,
+    // with partial boundaries inside the data
+    body = QByteArray();
+    while (body.size() < 100000) {
+        body.append("0123456789\r\n------WebKitFormBoundaryoPPQ");
+    }
+    query.clear();
+    query.addQueryItem(QStringLiteral("big"), QStringLiteral("big"));
+    query.addQueryItem(QStringLiteral("big"), QStringLiteral("big.bin"));
+    query.addQueryItem(QStringLiteral("big"), QStringLiteral("application/octet-stream"));
+    query.addQueryItem(QStringLiteral("big"), QString::number(body.size()));
+    query.addQueryItem(QStringLiteral("big"), QString::fromLatin1(QCryptographicHash::hash(body, QCryptographicHash::Sha256).toBase64()));
+    headers.clear();
+    headers.setHeader(QStringLiteral("sequential"), QStringLiteral("true"));
+    headers.setContentType(QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH"));
+    QTest::newRow("uploads-test02") << post << QStringLiteral("/request/test/uploads")
+                                    << headers << QByteArray(QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"big\"; filename=\"big.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n") + body + QByteArrayLiteral("\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n"))
+                                    << query.toString(QUrl::FullyEncoded).toLatin1();
 
     query.clear();
     headers.clear();
@@ -914,6 +1065,21 @@ void TestRequest::testController_data()
     QTest::newRow("upload-test00") << post << QStringLiteral("/request/test/upload/file1")
                                    << headers << QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\ntextooooo\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"file1\"; filename=\"wifi\"\r\nContent-Type: application/octet-stream\r\n\r\nMOTOCM\nMOTOCM\n00000000\n\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"file1\"; filename=\"example.txt\"\r\nContent-Type: application/octet-stream\r\n\r\nhttps://example.com/admin\n\n\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n")
                                    << QByteArrayLiteral("file1=wifi&file1=application/octet-stream&file1=23&file1=Nt4GUs/5oyPkWSe8ld+DZQWUTanILvYIjmZduHHNoFQ%3D");
+
+    headers.clear();
+    headers.setContentType(QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH"));
+    QTest::newRow("uploadSave-test00") << post << QStringLiteral("/request/test/uploadSave/file1")
+                                       << headers << QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\ntextooooo\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"file1\"; filename=\"wifi\"\r\nContent-Type: application/octet-stream\r\n\r\nMOTOCM\nMOTOCM\n00000000\n\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n")
+                                       << QByteArrayLiteral("Nt4GUs/5oyPkWSe8ld+DZQWUTanILvYIjmZduHHNoFQ=");
+
+    // Streamed to its own temporary file
+    body = QByteArray(300000, 'x');
+    headers.clear();
+    headers.setHeader(QStringLiteral("sequential"), QStringLiteral("true"));
+    headers.setContentType(QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH"));
+    QTest::newRow("uploadSave-test01") << post << QStringLiteral("/request/test/uploadSave/big")
+                                       << headers << QByteArray(QByteArrayLiteral("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\nContent-Disposition: form-data; name=\"big\"; filename=\"big.bin\"\r\n\r\n") + body + QByteArrayLiteral("\r\n------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n"))
+                                       << QCryptographicHash::hash(body, QCryptographicHash::Sha256).toBase64();
 }
 
 QByteArray createBody(QByteArray &result, int count)
@@ -986,6 +1152,62 @@ void TestRequest::testUploads_data()
                                  << headers << body << result;
 
 }
+
+void TestRequest::benchmarkMultiPart_data()
+{
+    QTest::addColumn<bool>("incremental");
+
+    QTest::newRow("random-access") << false;
+    QTest::newRow("incremental") << true;
+}
+
+void TestRequest::benchmarkMultiPart()
+{
+    QFETCH(bool, incremental);
+
+    // 1000 parts of 100KiB of binary data with line breaks and dashes
+    QByteArray data(100 * 1024, 'x');
+    for (int i = 0; i < data.size(); i += 61) {
+        data[i] = (i % 2) ? '\r' : '-';
+    }
+
+    QByteArray body;
+    body.reserve(1000 * (data.size() + 150));
+    for (int i = 0; i < 1000; ++i) {
+        body.append("------WebKitFormBoundaryoPPQLwBBssFnOTVH\r\n"
+                    "Content-Disposition: form-data; name=\"file-" + QByteArray::number(i) + "\"; filename=\"file.bin\"\r\n"
+                    "Content-Type: application/octet-stream\r\n\r\n");
+        body.append(data);
+        body.append("\r\n");
+    }
+    body.append("------WebKitFormBoundaryoPPQLwBBssFnOTVH--\r\n");
+
+    const QString contentType = QStringLiteral("multipart/form-data; boundary=----WebKitFormBoundaryoPPQLwBBssFnOTVH");
+    QBuffer buffer(&body);
+    buffer.open(QBuffer::ReadOnly);
+    Uploads uploads;
+    QBENCHMARK {
+        qDeleteAll(uploads);
+        if (incremental) {
+            // Parts larger than the memory limit go to temporary files, keep them in memory
+            MultiPartFormDataParser parser(contentType, body.size());
+            for (int pos = 0; pos < body.size(); pos += 64 * 1024) {
+                parser.feed(body.constData() + pos, qMin(64 * 1024, body.size() - pos));
+            }
+            uploads = parser.takeUploads();
+        } else {
+            buffer.seek(0);
+            uploads = MultiPartFormDataParser::parse(&buffer, contentType);
+        }
+    }
+
+    QCOMPARE(uploads.size(), 1000);
+    QCOMPARE(uploads.last()->name(), QStringLiteral("file-999"));
+    QCOMPARE(uploads.last()->size(), qint64(data.size()));
+    QCOMPARE(uploads.last()->readAll(), data);
+    qDeleteAll(uploads);
+}
+
 QTEST_MAIN(TestRequest)
 
 #include "testrequest.moc"
@@ -0,0 +1,245 @@
+#ifndef WEBSOCKETHUBTEST_H
+#define WEBSOCKETHUBTEST_H
+
+#include <QTest>
+#include <QObject>
+#include <QSignalSpy>
+
+#include "coverageobject.h"
+
+#include <Cutelyst/application.h>
+#include <Cutelyst/context.h>
+#include <Cutelyst/response.h>
+#include <Cutelyst/websockethub.h>
+
+using namespace Cutelyst;
+
+class HubTestEngine : public TestEngine
+{
+    Q_OBJECT
+public:
+    explicit HubTestEngine(Application *app) : TestEngine(app, QVariantMap()) {}
+
+    QHash<Context *, QList<QByteArray>> frames;
+    QHash<Context *, qint64> pending;
+    QHash<Context *, quint16> closed;
+    int prepared = 0;
+
+protected:
+    virtual QByteArray webSocketPrepareMessage(const QByteArray &payload, bool binary) override {
+        ++prepared;
+        return (binary ? QByteArrayLiteral("B:") : QByteArrayLiteral("T:")) + payload;
+    }
+
+    virtual bool webSocketSendFrame(Context *c, const QByteArray &frame) override {
+        frames[c].append(frame);
+        return true;
+    }
+
+    virtual qint64 webSocketBytesToWrite(Context *c) override {
+        return pending.value(c);
+    }
+
+    virtual bool webSocketClose(Context *c, quint16 code, const QString &reason) override {
+        Q_UNUSED(reason)
+        closed.insert(c, code);
+        return true;
+    }
+};
+
+class TestWebSocketHub : public CoverageObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void testSubscribe();
+    void testUnsubscribe();
+    void testPublish();
+    void testContextDestroyed();
+    void testDropMessage();
+    void testCloseConnection();
+
+    void cleanupTestCase();
+
+private:
+    HubTestEngine *m_engine;
+};
+
+void TestWebSocketHub::initTestCase()
+{
+    auto app = new TestApplication;
+    m_engine = new HubTestEngine(app);
+    QVERIFY(m_engine->init());
+}
+
+void TestWebSocketHub::cleanupTestCase()
+{
+    delete m_engine;
+}
+
+void TestWebSocketHub::testSubscribe()
+{
+    WebSocketHub hub;
+    Context c1(m_engine->app());
+    Context c2(m_engine->app());
+
+    hub.subscribe(&c1, QStringLiteral("news"));
+    hub.subscribe(&c1, QStringLiteral("news"));
+    hub.subscribe(&c2, QStringLiteral("news"));
+    hub.subscribe(&c2, QStringLiteral("sports"));
+
+    QStringList topics = hub.topics();
+    topics.sort();
+    QCOMPARE(topics, QStringList({ QStringLiteral("news"), QStringLiteral("sports") }));
+    QCOMPARE(hub.subscriberCount(QStringLiteral("news")), 2);
+    QCOMPARE(hub.subscriberCount(QStringLiteral("sports")), 1);
+    QCOMPARE(hub.subscriberCount(QStringLiteral("weather")), 0);
+}
+
+void TestWebSocketHub::testUnsubscribe()
+{
+    WebSocketHub hub;
+    Context c1(m_engine->app());
+    Context c2(m_engine->app());
+
+    hub.subscribe(&c1, QStringLiteral("news"));
+    hub.subscribe(&c1, QStringLiteral("sports"));
+    hub.subscribe(&c2, QStringLiteral("news"));
+
+    hub.unsubscribe(&c1, QStringLiteral("news"));
+    QCOMPARE(hub.subscriberCount(QStringLiteral("news")), 1);
+    QCOMPARE(hub.subscriberCount(QStringLiteral("sports")), 1);
+
+    // Not subscribed, nothing changes
+    hub.unsubscribe(&c2, QStringLiteral("sports"));
+    QCOMPARE(hub.subscriberCount(QStringLiteral("sports")), 1);
+
+    hub.unsubscribeAll(&c1);
+    QCOMPARE(hub.topics(), QStringList({ QStringLiteral("news") }));
+
+    hub.unsubscribe(&c2, QStringLiteral("news"));
+    QVERIFY(hub.topics().isEmpty());
+}
+
+void TestWebSocketHub::testPublish()
+{
+    WebSocketHub hub;
+    Context c1(m_engine->app());
+    Context c2(m_engine->app());
+    Context c3(m_engine->app());
+
+    hub.subscribe(&c1, QStringLiteral("news"));
+    hub.subscribe(&c2, QStringLiteral("news"));
+    hub.subscribe(&c3, QStringLiteral("sports"));
+
+    m_engine->frames.clear();
+    m_engine->prepared = 0;
+
+    QCOMPARE(hub.publishTextMessage(QStringLiteral("news"), QStringLiteral("hello")), 2);
+    // Framed once for all subscribers
+    QCOMPARE(m_engine->prepared, 1);
+    QCOMPARE(m_engine->frames.value(&c1), QList<QByteArray>({ QByteArrayLiteral("T:hello") }));
+    QCOMPARE(m_engine->frames.value(&c2), QList<QByteArray>({ QByteArrayLiteral("T:hello") }));
+    QVERIFY(m_engine->frames.value(&c3).isEmpty());
+
+    QCOMPARE(hub.publishBinaryMessage(QStringLiteral("sports"), QByteArrayLiteral("goal")), 1);
+    QCOMPARE(m_engine->frames.value(&c3), QList<QByteArray>({ QByteArrayLiteral("B:goal") }));
+
+    // Topics without subscribers are not framed at all
+    m_engine->prepared = 0;
+    QCOMPARE(hub.publishTextMessage(QStringLiteral("weather"), QStringLiteral("sun")), 0);
+    QCOMPARE(hub.publishBinaryMessage(QStringLiteral("weather"), QByteArrayLiteral("rain")), 0);
+    QCOMPARE(m_engine->prepared, 0);
+}
+
+void TestWebSocketHub::testContextDestroyed()
+{
+    WebSocketHub hub;
+    Context c1(m_engine->app());
+    auto c2 = new Context(m_engine->app());
+
+    hub.subscribe(&c1, QStringLiteral("news"));
+    hub.subscribe(c2, QStringLiteral("news"));
+    hub.subscribe(c2, QStringLiteral("sports"));
+
+    delete c2;
+
+    QCOMPARE(hub.topics(), QStringList({ QStringLiteral("news") }));
+    QCOMPARE(hub.subscriberCount(QStringLiteral("news")), 1);
+
+    m_engine->frames.clear();
+    QCOMPARE(hub.publishTextMessage(QStringLiteral("news"), QStringLiteral("hello")), 1);
+    QCOMPARE(m_engine->frames.size(), 1);
+}
+
+void TestWebSocketHub::testDropMessage()
+{
+    WebSocketHub hub;
+    QCOMPARE(hub.overflowPolicy(), WebSocketHub::DropMessage);
+    hub.setMaxPendingBytes(1024);
+    QCOMPARE(hub.maxPendingBytes(), qint64(1024));
+
+    Context fast(m_engine->app());
+    Context slow(m_engine->app());
+    hub.subscribe(&fast, QStringLiteral("news"));
+    hub.subscribe(&slow, QStringLiteral("news"));
+
+    m_engine->frames.clear();
+    m_engine->closed.clear();
+    m_engine->pending.insert(&slow, 2048);
+
+    QSignalSpy spy(&hub, &WebSocketHub::messageDropped);
+    QCOMPARE(hub.publishTextMessage(QStringLiteral("news"), QStringLiteral("hello")), 1);
+    QCOMPARE(spy.size(), 1);
+    QCOMPARE(spy.at(0).at(0).value<Context *>(), &slow);
+    QCOMPARE(spy.at(0).at(1).toString(), QStringLiteral("news"));
+
+    QVERIFY(m_engine->frames.value(&slow).isEmpty());
+    QCOMPARE(m_engine->frames.value(&fast).size(), 1);
+
+    // Dropping keeps the subscription and the connection
+    QVERIFY(m_engine->closed.isEmpty());
+    QCOMPARE(hub.subscriberCount(QStringLiteral("news")), 2);
+
+    m_engine->pending.remove(&slow);
+}
+
+void TestWebSocketHub::testCloseConnection()
+{
+    WebSocketHub hub;
+    hub.setMaxPendingBytes(1024);
+    hub.setOverflowPolicy(WebSocketHub::CloseConnection);
+    QCOMPARE(hub.overflowPolicy(), WebSocketHub::CloseConnection);
+
+    Context fast(m_engine->app());
+    Context slow(m_engine->app());
+    hub.subscribe(&fast, QStringLiteral("news"));
+    hub.subscribe(&slow, QStringLiteral("news"));
+    hub.subscribe(&slow, QStringLiteral("sports"));
+
+    m_engine->frames.clear();
+    m_engine->closed.clear();
+    m_engine->pending.insert(&slow, 2048);
+
+    QSignalSpy spy(&hub, &WebSocketHub::messageDropped);
+    QCOMPARE(hub.publishTextMessage(QStringLiteral("news"), QStringLiteral("hello")), 1);
+    QCOMPARE(spy.size(), 1);
+
+    QCOMPARE(m_engine->closed.value(&slow), quint16(Response::CloseCodePolicyViolated));
+    QCOMPARE(m_engine->closed.value(&slow), quint16(1008));
+    QVERIFY(!m_engine->closed.contains(&fast));
+
+    // The closed connection leaves all its topics
+    QCOMPARE(hub.subscriberCount(QStringLiteral("news")), 1);
+    QCOMPARE(hub.subscriberCount(QStringLiteral("sports")), 0);
+    QCOMPARE(hub.topics(), QStringList({ QStringLiteral("news") }));
+
+    m_engine->pending.remove(&slow);
+}
+
+QTEST_MAIN(TestWebSocketHub)
+
+#include "testwebsockethub.moc"
+
+#endif
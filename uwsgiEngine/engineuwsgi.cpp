@@ -77,6 +77,28 @@ qint64 uWSGI::doWrite(Context *c, const char *data, qint64 len, void *engineData
     return len;
 }
 
+void uWSGI::finalizeBody(Context *c)
+{
+    // Files are handed to uWSGI which uses sendfile() or its offload
+    // threads, instead of copying them through our buffers, chunked
+    // responses need the generic path to be framed and terminated
+    Response *response = c->response();
+    auto file = qobject_cast<QFile *>(response->bodyDevice());
+    if (file && file->handle() != -1 &&
+            response->headers().header(QStringLiteral("TRANSFER_ENCODING")) != QLatin1String("chunked")) {
+        const qint64 size = file->size();
+        // can_close = 0 as the file is still owned by the response,
+        // offloading works on a duplicated descriptor
+        if (size > 0 && uwsgi_response_sendfile_do_can_close(static_cast<wsgi_request*>(c->engineData()),
+                                                             file->handle(), 0, size, 0) != UWSGI_OK) {
+            qCWarning(CUTELYST_UWSGI) << "Failed to send file body";
+        }
+        return;
+    }
+
+    Engine::finalizeBody(c);
+}
+
 void uWSGI::readRequestUWSGI(wsgi_request *wsgi_req)
 {
     Q_FOREVER {
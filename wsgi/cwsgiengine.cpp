@@ -29,19 +29,24 @@
 #include "socket.h"
 
 #include "protocolwebsocket.h"
+#include "websocketdeflate.h"
+#include "websocketkeepalive.h"
 #include "protocolhttp.h"
 #include "protocolfastcgi.h"
+#include "protocoluwsgi.h"
 
 #ifdef Q_OS_UNIX
 #include "unixfork.h"
 #endif
 
 #include <typeinfo>
+#include <atomic>
 
 #include <Cutelyst/Context>
 #include <Cutelyst/Response>
 #include <Cutelyst/Request>
 #include <Cutelyst/Application>
+#include <Cutelyst/utils.h>
 
 #include <QCoreApplication>
 
@@ -52,15 +57,26 @@ Q_LOGGING_CATEGORY(CWSGI_ENGINE, "cwsgi.engine")
 using namespace CWSGI;
 using namespace Cutelyst;
 
-QByteArray dateHeader();
+namespace {
+// "\r\nDate: " followed by the RFC 7231 date, the timer writes the buffer
+// not in use and then publishes it by bumping the generation
+const int DateHeaderSize = 37;
+char dateHeaders[2][DateHeaderSize];
+std::atomic<int> dateGeneration(0);
+
+// WebSocket frames up to this size are written with a single call
+const int WebSocketCoalesceSize = 4096;
+}
 
 CWsgiEngine::CWsgiEngine(Application *localApp, int workerCore, const QVariantMap &opts, WSGI *wsgi) : Engine(localApp, workerCore, opts)
   , m_wsgi(wsgi)
 {
     defaultHeaders().setServer(QLatin1String("cutelyst/") + QLatin1String(VERSION));
 
-    m_lastDate = dateHeader();
-    m_lastDateTimer.start();
+    // Engines are created on the main thread before any of them serves requests
+    if (dateGeneration.load(std::memory_order_relaxed) == 0) {
+        updateDateHeader();
+    }
 
     const QStringList staticMap = m_wsgi->staticMap();
     const QStringList staticMap2 = m_wsgi->staticMap2();
@@ -80,6 +96,10 @@ CWsgiEngine::CWsgiEngine(Application *localApp, int workerCore, const QVariantMa
         m_socketTimeout = new QTimer(this);
         m_socketTimeout->setInterval(m_wsgi->socketTimeout() * 1000);
     }
+
+    if (m_wsgi->websocketPingInterval()) {
+        m_webSocketKeepAlive = new WebSocketKeepAlive(m_wsgi->websocketPingInterval(), m_wsgi->websocketPongTimeout(), this);
+    }
 }
 
 int CWsgiEngine::workerId() const
@@ -87,6 +107,13 @@ int CWsgiEngine::workerId() const
     return m_workerId;
 }
 
+void CWsgiEngine::webSocketKeepAliveRemove(Socket *sock)
+{
+    if (m_webSocketKeepAlive) {
+        m_webSocketKeepAlive->remove(sock);
+    }
+}
+
 void CWsgiEngine::setServers(const std::vector<QObject *> &servers)
 {
     for (QObject *server : servers) {
@@ -109,6 +136,11 @@ void CWsgiEngine::setServers(const std::vector<QObject *> &servers)
                         m_protoFcgi = new ProtocolFastCGI(m_wsgi);
                     }
                     server->setProtocol(m_protoFcgi);
+                } else if (server->protocol()->type() == Protocol::Uwsgi) {
+                    if (!m_protoUwsgi) {
+                        m_protoUwsgi = new ProtocolUwsgi(m_wsgi);
+                    }
+                    server->setProtocol(m_protoUwsgi);
                 }
             }
         }
@@ -132,6 +164,11 @@ void CWsgiEngine::setServers(const std::vector<QObject *> &servers)
                         m_protoFcgi = new ProtocolFastCGI(m_wsgi);
                     }
                     server->setProtocol(m_protoFcgi);
+                } else if (server->protocol()->type() == Protocol::Uwsgi) {
+                    if (!m_protoUwsgi) {
+                        m_protoUwsgi = new ProtocolUwsgi(m_wsgi);
+                    }
+                    server->setProtocol(m_protoUwsgi);
                 }
             }
         }
@@ -155,21 +192,35 @@ void CWsgiEngine::postFork(int workerId)
     Q_EMIT started();
 }
 
-QByteArray dateHeader()
+void CWsgiEngine::updateDateHeader()
 {
-    QString ret;
-    ret = QLatin1String("\r\nDate: ") + QLocale::c().toString(QDateTime::currentDateTimeUtc(),
-                                                              QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT"));
-    return ret.toLatin1();
+    const int generation = dateGeneration.load(std::memory_order_relaxed) + 1;
+    // Keeps the previous publish ordered before the buffer is rewritten,
+    // so readers of this buffer see the generation change and retry
+    std::atomic_thread_fence(std::memory_order_release);
+    char *header = dateHeaders[generation & 1];
+    memcpy(header, "\r\nDate: ", 8);
+    Utils::formatHttpDate(QDateTime::currentMSecsSinceEpoch() / 1000, header + 8);
+    dateGeneration.store(generation, std::memory_order_release);
 }
 
 bool CWsgiEngine::finalizeHeadersWrite(Context *c, quint16 status, const Headers &headers, void *engineData)
 {
     auto sock = static_cast<TcpSocket*>(engineData);
     if (sock) {
-        if (m_lastDateTimer.hasExpired(1000)) {
-            m_lastDate = dateHeader();
-            m_lastDateTimer.restart();
+        int generation = dateGeneration.load(std::memory_order_acquire);
+        if (m_lastDateGeneration != generation) {
+            Q_FOREVER {
+                m_lastDate = QByteArray(dateHeaders[generation & 1], DateHeaderSize);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const int current = dateGeneration.load(std::memory_order_relaxed);
+                if (current == generation) {
+                    break;
+                }
+                // The timer moved on while copying, the buffer might be torn
+                generation = current;
+            }
+            m_lastDateGeneration = generation;
         }
 
         return sock->proto->sendHeaders(sock, sock, status, m_lastDate, headers);
@@ -228,8 +279,27 @@ bool CWsgiEngine::webSocketHandshakeDo(Context *c, const QString &key, const QSt
     const QByteArray wsAccept = QCryptographicHash::hash(wsKey.toLatin1(), QCryptographicHash::Sha1).toBase64();
     headers.setHeader(QStringLiteral("SEC_WEBSOCKET_ACCEPT"), QString::fromLatin1(wsAccept));
 
+    if (m_wsgi->websocketCompression()) {
+        const QString offers = requestHeaders.header(QStringLiteral("SEC_WEBSOCKET_EXTENSIONS"));
+        if (!offers.isEmpty()) {
+            QString extension;
+            WebSocketDeflate *deflate = WebSocketDeflate::negotiate(offers,
+                                                                    m_wsgi->websocketCompressionWindowBits(),
+                                                                    m_wsgi->websocketCompressionNoContextTakeover(),
+                                                                    &extension);
+            if (deflate) {
+                delete sock->websocket_deflate;
+                sock->websocket_deflate = deflate;
+                headers.setHeader(QStringLiteral("SEC_WEBSOCKET_EXTENSIONS"), extension);
+            }
+        }
+    }
+
     sock->headerConnection = Socket::HeaderConnectionUpgrade;
     sock->websocketContext = c;
+    if (m_webSocketKeepAlive) {
+        m_webSocketKeepAlive->add(sock);
+    }
 
     return finalizeHeadersWrite(c, Response::SwitchingProtocols, headers, engineData);
 }
@@ -241,10 +311,7 @@ bool CWsgiEngine::webSocketSendTextMessage(Context *c, const QString &message)
         return false;
     }
 
-    const QByteArray rawMessage = message.toUtf8();
-    const QByteArray headers = ProtocolWebSocket::createWebsocketHeader(Socket::OpCodeText, rawMessage.size());
-    doWrite(c, headers.data(), headers.size(), sock);
-    return doWrite(c, rawMessage.data(), rawMessage.size(), sock) == rawMessage.size();
+    return webSocketSendMessage(c, sock, Socket::OpCodeText, message.toUtf8());
 }
 
 bool CWsgiEngine::webSocketSendBinaryMessage(Context *c, const QByteArray &message)
@@ -254,9 +321,7 @@ bool CWsgiEngine::webSocketSendBinaryMessage(Context *c, const QByteArray &messa
         return false;
     }
 
-    const QByteArray headers = ProtocolWebSocket::createWebsocketHeader(Socket::OpCodeBinary, message.size());
-    doWrite(c, headers.data(), headers.size(), sock);
-    return doWrite(c, message.data(), message.size(), sock) == message.size();
+    return webSocketSendMessage(c, sock, Socket::OpCodeBinary, message);
 }
 
 bool CWsgiEngine::webSocketSendPing(Context *c, const QByteArray &payload)
@@ -266,10 +331,7 @@ bool CWsgiEngine::webSocketSendPing(Context *c, const QByteArray &payload)
         return false;
     }
 
-    const QByteArray rawMessage = payload.left(125);
-    const QByteArray headers = ProtocolWebSocket::createWebsocketHeader(Socket::OpCodePing, rawMessage.size());
-    doWrite(c, headers.data(), headers.size(), sock);
-    return doWrite(c, rawMessage.data(), rawMessage.size(), sock) == rawMessage.size();
+    return webSocketWriteFrame(c, sock, Socket::OpCodePing, payload.constData(), qMin(payload.size(), 125), false);
 }
 
 bool CWsgiEngine::webSocketClose(Context *c, quint16 code, const QString &reason)
@@ -283,6 +345,63 @@ bool CWsgiEngine::webSocketClose(Context *c, quint16 code, const QString &reason
     return doWrite(c, reply.data(), reply.size(), sock) == reply.size();
 }
 
+QByteArray CWsgiEngine::webSocketPrepareMessage(const QByteArray &payload, bool binary)
+{
+    char header[ProtocolWebSocket::WebsocketMaxHeaderSize];
+    const int headerSize = ProtocolWebSocket::writeWebsocketHeader(header, binary ? Socket::OpCodeBinary : Socket::OpCodeText, payload.size(), false);
+
+    QByteArray frame(headerSize + payload.size(), Qt::Uninitialized);
+    memcpy(frame.data(), header, headerSize);
+    memcpy(frame.data() + headerSize, payload.constData(), payload.size());
+    return frame;
+}
+
+bool CWsgiEngine::webSocketSendFrame(Context *c, const QByteArray &frame)
+{
+    auto sock = static_cast<TcpSocket*>(c->engineData());
+    if (sock->headerConnection != Socket::HeaderConnectionUpgrade) {
+        return false;
+    }
+
+    return doWrite(c, frame.constData(), frame.size(), sock) == frame.size();
+}
+
+qint64 CWsgiEngine::webSocketBytesToWrite(Context *c)
+{
+    auto io = static_cast<QIODevice*>(c->engineData());
+    return io->bytesToWrite();
+}
+
+bool CWsgiEngine::webSocketSendMessage(Context *c, TcpSocket *sock, quint8 opcode, const QByteArray &message)
+{
+    // Tiny messages grow when deflated
+    if (sock->websocket_deflate && message.size() >= 32) {
+        QByteArray compressed;
+        if (sock->websocket_deflate->compress(message.constData(), message.size(), compressed)) {
+            return webSocketWriteFrame(c, sock, opcode, compressed.constData(), compressed.size(), true);
+        }
+    }
+
+    return webSocketWriteFrame(c, sock, opcode, message.constData(), message.size(), false);
+}
+
+bool CWsgiEngine::webSocketWriteFrame(Context *c, TcpSocket *sock, quint8 opcode, const char *data, int len, bool compressed)
+{
+    char frame[WebSocketCoalesceSize];
+    const int headerSize = ProtocolWebSocket::writeWebsocketHeader(frame, opcode, len, compressed);
+    if (len <= WebSocketCoalesceSize - headerSize) {
+        // Header and payload go out together, which avoids a tiny
+        // header segment being held back by Nagle's algorithm
+        memcpy(frame + headerSize, data, len);
+        return doWrite(c, frame, headerSize + len, sock) == headerSize + len;
+    }
+
+    // Copying big payloads costs more than the extra call,
+    // the socket buffer still sends them in the same segments
+    doWrite(c, frame, headerSize, sock);
+    return doWrite(c, data, len, sock) == len;
+}
+
 bool CWsgiEngine::init()
 {
     if (!initApplication()) {
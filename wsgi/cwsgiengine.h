@@ -20,7 +20,6 @@
 #define CWSGI_ENGINE_H
 
 #include <QObject>
-#include <QElapsedTimer>
 #include <QTimer>
 
 #include <Cutelyst/Engine>
@@ -30,7 +29,11 @@ class QTcpServer;
 namespace CWSGI {
 
 class TcpServer;
+class TcpSocket;
+class Socket;
+class WebSocketKeepAlive;
 class ProtocolFastCGI;
+class ProtocolUwsgi;
 class ProtocolHttp;
 class WSGI;
 class CWsgiEngine : public Cutelyst::Engine
@@ -53,6 +56,17 @@ public:
 
     virtual bool init() override;
 
+    /**
+     * Formats the Date header shared by all engines of this process,
+     * called once a second by a single timer.
+     */
+    static void updateDateHeader();
+
+    /**
+     * Stops the keepalive of a WebSocket connection that is going away
+     */
+    void webSocketKeepAliveRemove(Socket *sock);
+
 Q_SIGNALS:
     void started();
     void shutdown();
@@ -73,6 +87,12 @@ protected:
 
     virtual bool webSocketClose(Cutelyst::Context *c, quint16 code, const QString &reason) override;
 
+    virtual QByteArray webSocketPrepareMessage(const QByteArray &payload, bool binary) override;
+
+    virtual bool webSocketSendFrame(Cutelyst::Context *c, const QByteArray &frame) override;
+
+    virtual qint64 webSocketBytesToWrite(Cutelyst::Context *c) override;
+
     inline void startSocketTimeout() {
         if (m_socketTimeout && ++m_serversTimeout == 1) {
             m_socketTimeout->start();
@@ -94,16 +114,23 @@ protected:
 private:
     friend class ProtocolHttp;
     friend class ProtocolFastCGI;
+    friend class ProtocolUwsgi;
     friend class LocalServer;
     friend class TcpServer;
     friend class TcpSslServer;
+    friend class WebSocketKeepAlive;
+
+    bool webSocketSendMessage(Cutelyst::Context *c, TcpSocket *sock, quint8 opcode, const QByteArray &message);
+    bool webSocketWriteFrame(Cutelyst::Context *c, TcpSocket *sock, quint8 opcode, const char *data, int len, bool compressed);
 
     QByteArray m_lastDate;
-    QElapsedTimer m_lastDateTimer;
+    int m_lastDateGeneration = -1;
     QTimer *m_socketTimeout = nullptr;
+    WebSocketKeepAlive *m_webSocketKeepAlive = nullptr;
     WSGI *m_wsgi;
     ProtocolHttp *m_protoHttp = nullptr;
     ProtocolFastCGI *m_protoFcgi = nullptr;
+    ProtocolUwsgi *m_protoUwsgi = nullptr;
     int m_runningServers = 0;
     int m_serversTimeout = 0;
 };
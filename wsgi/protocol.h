@@ -33,7 +33,8 @@ public:
     enum Type {
         Unknown,
         Http11,
-        FastCGI1
+        FastCGI1,
+        Uwsgi
     };
 
     Protocol(WSGI *wsgi);
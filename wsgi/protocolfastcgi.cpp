@@ -175,12 +175,10 @@ quint16 wsgi_be16(const char *buf) {
     return ret;
 }
 
-quint16 ProtocolFastCGI::addHeader(Socket *wsgi_req, const char *key, quint16 keylen, const char *val, quint16 vallen) const
+template <typename Request>
+quint16 ProtocolFastCGI::addHeader(Request *wsgi_req, const char *key, quint16 keylen, const char *val, quint16 vallen) const
 {
-    char *buffer = wsgi_req->buffer + wsgi_req->pktsize;
-    char *watermark = wsgi_req->buffer + m_bufferSize;
-
-    if (buffer + keylen + vallen + 2 + 2 >= watermark) {
+    if (wsgi_req->pktsize + keylen + vallen + 2 + 2 >= m_bufferSize) {
         qCWarning(CWSGI_FCGI, "unable to add %.*s=%.*s to wsgi packet, consider increasing buffer size", keylen, key, vallen, val);
         return 0;
     }
@@ -230,7 +228,8 @@ quint16 ProtocolFastCGI::addHeader(Socket *wsgi_req, const char *key, quint16 ke
     return keylen + vallen + 2 + 2;
 }
 
-int ProtocolFastCGI::parseHeaders(Socket *wsgi_req, const char *buf, size_t len) const
+template <typename Request>
+int ProtocolFastCGI::parseHeaders(Request *wsgi_req, const char *buf, size_t len) const
 {
     size_t j;
     quint8 octet;
@@ -280,7 +279,26 @@ int ProtocolFastCGI::parseHeaders(Socket *wsgi_req, const char *buf, size_t len)
     return 0;
 }
 
-int ProtocolFastCGI::processPacket(Socket *sock) const
+// Records up to this size are framed in a single buffer and written at once
+const int FastCgiCoalesceSize = 8192;
+
+static inline int fcgi_write_record_header(char *buf, quint8 type, quint16 requestId, quint16 len)
+{
+    const quint8 padding = static_cast<quint8>(FCGI_ALIGN(len) - len);
+    buf[0] = FCGI_VERSION_1;
+    buf[1] = static_cast<char>(type);
+    buf[2] = static_cast<char>(requestId >> 8);
+    buf[3] = static_cast<char>(requestId & 0xff);
+    buf[4] = static_cast<char>(len >> 8);
+    buf[5] = static_cast<char>(len & 0xff);
+    buf[6] = static_cast<char>(padding);
+    buf[7] = 0;
+    return padding;
+}
+
+static void wsgi_proto_fastcgi_endrequest(QIODevice *io, quint16 requestId, quint8 protocolStatus = FCGI_REQUEST_COMPLETE);
+
+int ProtocolFastCGI::processPacket(Socket *sock, QIODevice *io, quint16 *requestId) const
 {
     Q_FOREVER {
         if (sock->buf_size >= sizeof(struct fcgi_record)) {
@@ -289,46 +307,102 @@ int ProtocolFastCGI::processPacket(Socket *sock) const
             quint16 fcgi_len = wsgi_be16(reinterpret_cast<const char *>(&fr->cl1));
             quint32 fcgi_all_len = sizeof(struct fcgi_record) + fcgi_len + fr->pad;
             quint8 fcgi_type = fr->type;
-            quint8 *sid = reinterpret_cast<quint8 *>(& sock->stream_id);
-            sid[0] = fr->req0;
-            sid[1] = fr->req1;
+            const quint16 id = static_cast<quint16>((fr->req1 << 8) | fr->req0);
+
+            // Records of the request being received first use the socket,
+            // the ones of other requests multiplexed with it have their own state
+            FastCgiStream *stream = nullptr;
+            if (id != sock->stream_id && fcgi_type != FCGI_BEGIN_REQUEST && fcgi_type != FCGI_GET_VALUES) {
+                stream = sock->fcgi_streams.value(id);
+                if (!stream) {
+                    qCWarning(CWSGI_FCGI) << "Record for unknown request id" << id << "type" << fcgi_type;
+                    return WSGI_ERROR;
+                }
+            }
 
             // if STDIN, end of the loop
             if (fcgi_type == FCGI_STDIN) {
                 if (fcgi_len == 0) {
+                    if (sock->buf_size < fcgi_all_len) {
+                        break;
+                    }
                     memmove(sock->buffer, sock->buffer + fcgi_all_len, sock->buf_size - fcgi_all_len);
                     sock->buf_size -= fcgi_all_len;
+                    *requestId = id;
                     return WSGI_OK;
                 }
 
-                quint16 content_size = sock->buf_size - sizeof(struct fcgi_record);
-                if (!writeBody(sock, sock->buffer + sizeof(struct fcgi_record),
-                               qMin(content_size, fcgi_len))) {
+                const quint32 content_size = qMin(sock->buf_size - static_cast<quint32>(sizeof(struct fcgi_record)), static_cast<quint32>(fcgi_len));
+                const bool ok = stream ? writeBody(stream, sock->buffer + sizeof(struct fcgi_record), content_size)
+                                       : writeBody(sock, sock->buffer + sizeof(struct fcgi_record), content_size);
+                if (!ok) {
                     return WSGI_ERROR;
                 }
 
-                if (content_size < fcgi_len) {
-                    // we still need the rest of the pkt body
+                if (sock->buf_size < fcgi_all_len) {
+                    // we still need the rest of the pkt body and its padding
                     sock->connState = Socket::ContentBody;
+                    sock->fcgi_body = stream ? stream->body : sock->body;
                     sock->pktsize = fcgi_len - content_size;
-                    sock->buf_size = fr->pad;
+                    sock->buf_size = fcgi_all_len - sock->buf_size - sock->pktsize;
                     return WSGI_BODY;
                 }
 
                 memmove(sock->buffer, sock->buffer + fcgi_all_len, sock->buf_size - fcgi_all_len);
                 sock->buf_size -= fcgi_all_len;
             } else if (sock->buf_size >= fcgi_all_len) {
+                const char *content = sock->buffer + sizeof(struct fcgi_record);
+
                 // PARAMS ? (ignore other types)
                 if (fcgi_type == FCGI_PARAMS) {
-                    if (parseHeaders(sock, sock->buffer + sizeof(struct fcgi_record), fcgi_len)) {
+                    if (stream ? parseHeaders(stream, content, fcgi_len) : parseHeaders(sock, content, fcgi_len)) {
                         return WSGI_ERROR;
                     }
                 } else if (fcgi_type == FCGI_BEGIN_REQUEST) {
-                    auto brb = reinterpret_cast<struct fcgi_begin_request_body *>(sock->buffer + sizeof(struct fcgi_begin_request_body));
-                    sock->headerConnection = (brb->flags & FCGI_KEEP_CONN) ? Socket::HeaderConnectionKeep : Socket::HeaderConnectionClose;
-                    sock->contentLength = -1;
-                    sock->headers = Cutelyst::Headers();
-                    sock->connState = Socket::MethodLine;
+                    auto brb = reinterpret_cast<const struct fcgi_begin_request_body *>(content);
+                    const bool keepConn = brb->flags & FCGI_KEEP_CONN;
+                    if (!sock->stream_id) {
+                        sock->stream_id = id;
+                        sock->headerConnection = keepConn ? Socket::HeaderConnectionKeep : Socket::HeaderConnectionClose;
+                        sock->contentLength = -1;
+                        sock->headers = Cutelyst::Headers();
+                        sock->connState = Socket::MethodLine;
+                    } else if (id != sock->stream_id && !sock->fcgi_streams.contains(id)) {
+                        stream = new FastCgiStream;
+                        stream->requestPtr = sock->requestPtr;
+                        stream->startOfRequest = sock->engine->time();
+                        stream->keepConn = keepConn;
+                        sock->fcgi_streams.insert(id, stream);
+                    } else {
+                        qCWarning(CWSGI_FCGI) << "Request id already in use" << id;
+                        return WSGI_ERROR;
+                    }
+                } else if (fcgi_type == FCGI_ABORT_REQUEST) {
+                    if (stream) {
+                        delete sock->fcgi_streams.take(id);
+                    } else {
+                        // Nothing of the request was processed yet, forget it
+                        QHash<quint16, FastCgiStream *> streams;
+                        streams.swap(sock->fcgi_streams);
+                        const auto size = sock->buf_size - fcgi_all_len;
+                        memmove(sock->buffer, sock->buffer + fcgi_all_len, size);
+                        sock->resetSocket();
+                        sock->buf_size = size;
+                        sock->fcgi_streams.swap(streams);
+                        wsgi_proto_fastcgi_endrequest(io, id);
+                        continue;
+                    }
+                    wsgi_proto_fastcgi_endrequest(io, id);
+                } else if (fcgi_type == FCGI_GET_VALUES) {
+                    // Let the web server know requests can share a connection
+                    if (QByteArray::fromRawData(content, fcgi_len).contains(FCGI_MPXS_CONNS)) {
+                        static const char pair[] = "\x0f\1" FCGI_MPXS_CONNS "1";
+                        char values[sizeof(struct fcgi_record) + FCGI_ALIGN(sizeof(pair) - 1)];
+                        const int padding = fcgi_write_record_header(values, FCGI_GET_VALUES_RESULT, FCGI_NULL_REQUEST_ID, sizeof(pair) - 1);
+                        memcpy(values + sizeof(struct fcgi_record), pair, sizeof(pair) - 1);
+                        memset(values + sizeof(struct fcgi_record) + sizeof(pair) - 1, 0, padding);
+                        io->write(values, sizeof(values));
+                    }
                 }
 
                 memmove(sock->buffer, sock->buffer + fcgi_all_len, sock->buf_size - fcgi_all_len);
@@ -343,7 +417,8 @@ int ProtocolFastCGI::processPacket(Socket *sock) const
     return WSGI_AGAIN; // read again
 }
 
-bool ProtocolFastCGI::writeBody(Socket *sock, char *buf, qint64 len) const
+template <typename Request>
+bool ProtocolFastCGI::writeBody(Request *sock, char *buf, qint64 len) const
 {
     if (sock->body) {
         return sock->body->write(buf, len) == len;
@@ -374,79 +449,101 @@ bool ProtocolFastCGI::writeBody(Socket *sock, char *buf, qint64 len) const
 
 int ProtocolFastCGI::wsgi_proto_fastcgi_write(QIODevice *io, Socket *wsgi_req, const char *buf, int len)
 {
-    // reset for next write
+    char record[FastCgiCoalesceSize];
     int write_pos = 0;
-    quint32 proto_parser_status = 0;
 
-    Q_FOREVER {
+    while (write_pos < len) {
         // fastcgi packets are limited to 64k
-        quint8 padding = 0;
-
-        if (proto_parser_status == 0) {
-            quint16 fcgi_len = qMin(len - write_pos, 0xffff);
-            proto_parser_status = fcgi_len;
-
-            struct fcgi_record fr;
-            fr.version = FCGI_VERSION_1;
-            fr.type = FCGI_STDOUT;
-
-            quint8 *sid = reinterpret_cast<quint8 *>(&wsgi_req->stream_id);
-            fr.req1 = sid[1];
-            fr.req0 = sid[0];
-
-            quint16 padded_len = FCGI_ALIGN(fcgi_len);
-            if (padded_len > fcgi_len) {
-                padding = padded_len - fcgi_len;
+        const quint16 fcgi_len = static_cast<quint16>(qMin(len - write_pos, 0xffff));
+        const int padding = fcgi_write_record_header(record, FCGI_STDOUT, static_cast<quint16>(wsgi_req->stream_id), fcgi_len);
+        const int all_len = sizeof(struct fcgi_record) + fcgi_len + padding;
+
+        if (all_len <= FastCgiCoalesceSize) {
+            memcpy(record + sizeof(struct fcgi_record), buf + write_pos, fcgi_len);
+            memset(record + sizeof(struct fcgi_record) + fcgi_len, 0, padding);
+            if (io->write(record, all_len) != all_len) {
+                qCWarning(CWSGI_FCGI) << "Writing socket error" << io->errorString();
+                return -1;
             }
-            fr.pad = padding;
-
-            fr.reserved = 0;
-            fr.cl0 = static_cast<quint8>(fcgi_len & 0xff);
-            fr.cl1 = static_cast<quint8>((fcgi_len >> 8) & 0xff);
-            if (io->write(reinterpret_cast<const char *>(&fr), sizeof(struct fcgi_record)) != sizeof(struct fcgi_record)) {
+        } else {
+            // Copying a big payload just to save a call isn't worth it
+            memset(record + sizeof(struct fcgi_record), 0, padding);
+            if (io->write(record, sizeof(struct fcgi_record)) != sizeof(struct fcgi_record) ||
+                    io->write(buf + write_pos, fcgi_len) != fcgi_len ||
+                    (padding && io->write(record + sizeof(struct fcgi_record), padding) != padding)) {
+                qCWarning(CWSGI_FCGI) << "Writing socket error" << io->errorString();
                 return -1;
             }
         }
 
-        qint64 wlen = io->write(buf + write_pos, proto_parser_status);
-        if (padding) {
-            io->write("\0\0\0\0\0\0\0\0\0", padding);
-        }
-
-        if (wlen > 0) {
-            write_pos += wlen;
-            proto_parser_status -= wlen;
-            if (write_pos == len) {
-                return WSGI_OK;
-            }
-            continue;
-        }
-        if (wlen < 0) {
-            qCWarning(CWSGI_FCGI) << "Writing socket error" << io->errorString();
-        }
-        return -1;
+        write_pos += fcgi_len;
     }
+
+    return WSGI_OK;
 }
 
-#define FCGI_END_REQUEST_DATA "\1\x06\0\1\0\0\0\0\1\3\0\1\0\x08\0\0\0\0\0\0\0\0\0\0"
+static void wsgi_proto_fastcgi_endrequest(QIODevice *io, quint16 requestId, quint8 protocolStatus)
+{
+    // An empty STDOUT record closes the stream, written
+    // together with END_REQUEST
+    char end_request[2 * sizeof(struct fcgi_record) + 8];
+    fcgi_write_record_header(end_request, FCGI_STDOUT, requestId, 0);
+    fcgi_write_record_header(end_request + sizeof(struct fcgi_record), FCGI_END_REQUEST, requestId, 8);
+    char *body = end_request + 2 * sizeof(struct fcgi_record);
+    memset(body, 0, 8);
+    body[4] = static_cast<char>(protocolStatus);
+    io->write(end_request, sizeof(end_request));
+}
 
-void wsgi_proto_fastcgi_endrequest(Socket *wsgi_req, QIODevice *io)
+bool ProtocolFastCGI::finishRequest(Socket *sock, QIODevice *io, quint16 requestId) const
 {
-    char end_request[] = FCGI_END_REQUEST_DATA;
-//    memcpy(end_request, FCGI_END_REQUEST_DATA, 24);
-    char *sid = (char *) &wsgi_req->stream_id;
-    // update with request id
-    end_request[2] = sid[1];
-    end_request[3] = sid[0];
-    end_request[10] = sid[1];
-    end_request[11] = sid[0];
-    io->write(end_request, 24);
+    if (requestId == sock->stream_id) {
+        sock->processing = true;
+        delete sock->engine->processSocket(sock);
+        wsgi_proto_fastcgi_endrequest(io, requestId);
+        sock->processing = false;
+
+        if (sock->headerConnection == Socket::HeaderConnectionClose) {
+            // Web server did not set FCGI_KEEP_CONN
+            sock->connectionClose();
+            return false;
+        }
+
+        // Multiplexed requests still being received survive the reset
+        QHash<quint16, FastCgiStream *> streams;
+        streams.swap(sock->fcgi_streams);
+        auto size = sock->buf_size;
+        sock->resetSocket();
+        sock->buf_size = size;
+        sock->fcgi_streams.swap(streams);
+        return true;
+    }
+
+    // Responses are written with the id in stream_id
+    FastCgiStream *stream = sock->fcgi_streams.take(requestId);
+    const quint64 streamId = sock->stream_id;
+    sock->stream_id = requestId;
+
+    sock->processing = true;
+    delete sock->engine->processSocket(stream);
+    wsgi_proto_fastcgi_endrequest(io, requestId);
+    sock->processing = false;
+
+    sock->stream_id = streamId;
+    const bool keepConn = stream->keepConn;
+    delete stream;
+
+    if (!keepConn) {
+        sock->connectionClose();
+        return false;
+    }
+    return true;
 }
 
 qint64 ProtocolFastCGI::readBody(Socket *sock, QIODevice *io, qint64 bytesAvailable) const
 {
     int len;
-    QIODevice *body = sock->body;
+    QIODevice *body = sock->fcgi_body;
     quint32 &pad = sock->buf_size;
     while (bytesAvailable && sock->pktsize + pad) {
         // We need to read and ignore ending PAD data
@@ -503,32 +600,29 @@ void ProtocolFastCGI::readyRead(Socket *sock, QIODevice *io) const
                 continue;
             }
 
-            int ret = processPacket(sock);
-            if (ret == WSGI_AGAIN) {
-                continue;
-            } else if (ret == WSGI_OK) {
-                sock->processing = true;
-                delete sock->engine->processSocket(sock);
-                wsgi_proto_fastcgi_endrequest(sock, io);
-                sock->processing = false;
-
-                if (sock->headerConnection == Socket::HeaderConnectionClose) {
-                    // Web server did not set FCGI_KEEP_CONN
-                    sock->connectionClose();
-                    return;
-                }
-
-                auto size = sock->buf_size;
-                sock->resetSocket();
-                sock->buf_size = size;
-            } else if (ret == WSGI_BODY) {
-                bytesAvailable = readBody(sock, io, bytesAvailable);
-                if (bytesAvailable == -1) {
+            // The buffer may hold records of several requests
+            Q_FOREVER {
+                quint16 requestId = 0;
+                int ret = processPacket(sock, io, &requestId);
+                if (ret == WSGI_AGAIN) {
+                    break;
+                } else if (ret == WSGI_OK) {
+                    if (!finishRequest(sock, io, requestId)) {
+                        return;
+                    }
+                } else if (ret == WSGI_BODY) {
+                    bytesAvailable = readBody(sock, io, bytesAvailable);
+                    if (bytesAvailable == -1) {
+                        return;
+                    }
+                    if (sock->connState == Socket::ContentBody) {
+                        break;
+                    }
+                } else {
+                    // On error disconnect immediately
+                    io->close();
                     return;
                 }
-            } else {
-                // On error disconnect immediately
-                io->close();
             }
         } else {
             qCWarning(CWSGI_FCGI) << "Failed to read from socket" << io->errorString();
@@ -545,7 +639,8 @@ bool ProtocolFastCGI::sendHeaders(QIODevice *io, Socket *sock, quint16 status, c
                                                        return ret;
                                                    }());
 
-    headerBuffer.resize(0);
+    // Room for the record header, filled once the size is known
+    headerBuffer.resize(sizeof(struct fcgi_record));
     headerBuffer.append(QByteArrayLiteral("Status: ") + QByteArray::number(status));
 
     const auto headersData = headers.data();
@@ -572,7 +667,15 @@ bool ProtocolFastCGI::sendHeaders(QIODevice *io, Socket *sock, quint16 status, c
     }
     headerBuffer.append("\r\n\r\n", 4);
 
-    return wsgi_proto_fastcgi_write(io, sock, headerBuffer.constData(), headerBuffer.size()) == 0;
+    const int len = headerBuffer.size() - static_cast<int>(sizeof(struct fcgi_record));
+    if (len > 0xffff) {
+        return wsgi_proto_fastcgi_write(io, sock, headerBuffer.constData() + sizeof(struct fcgi_record), len) == 0;
+    }
+
+    // Frame the headers in place so they go out with a single write
+    const int padding = fcgi_write_record_header(headerBuffer.data(), FCGI_STDOUT, static_cast<quint16>(sock->stream_id), static_cast<quint16>(len));
+    headerBuffer.append("\0\0\0\0\0\0\0", padding);
+    return io->write(headerBuffer) == headerBuffer.size();
 }
 
 qint64 ProtocolFastCGI::sendBody(QIODevice *io, Socket *sock, const char *data, qint64 len)
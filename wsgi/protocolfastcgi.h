@@ -40,10 +40,15 @@ public:
     qint64 sendBody(QIODevice *io, Socket *sock, const char *data, qint64 len) override;
 
 private:
-    inline quint16 addHeader(Socket *wsgi_req, const char *key, quint16 keylen, const char *val, quint16 vallen) const;
-    inline int parseHeaders(Socket *wsgi_req, const char *buf, size_t len) const;
-    inline int processPacket(Socket *sock) const;
-    inline bool writeBody(Socket *sock, char *buf, qint64 len) const;
+    // Request is either the Socket or a multiplexed FastCgiStream
+    template <typename Request>
+    inline quint16 addHeader(Request *wsgi_req, const char *key, quint16 keylen, const char *val, quint16 vallen) const;
+    template <typename Request>
+    inline int parseHeaders(Request *wsgi_req, const char *buf, size_t len) const;
+    template <typename Request>
+    inline bool writeBody(Request *req, char *buf, qint64 len) const;
+    inline int processPacket(Socket *sock, QIODevice *io, quint16 *requestId) const;
+    inline bool finishRequest(Socket *sock, QIODevice *io, quint16 requestId) const;
     // write a STDOUT packet
     int wsgi_proto_fastcgi_write(QIODevice *io, Socket *wsgi_req, const char *buf, int len);
 };
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include "protocoluwsgi.h"
+
+#include "socket.h"
+#include "wsgi.h"
+
+#include <Cutelyst/Context>
+
+#include <QLoggingCategory>
+#include <QTemporaryFile>
+#include <QBuffer>
+
+Q_LOGGING_CATEGORY(CWSGI_UWSGI, "cwsgi.uwsgi")
+
+using namespace CWSGI;
+
+#define UWSGI_HEADER_LEN 4
+
+static inline quint16 uwsgi_le16(const char *buf)
+{
+    return static_cast<quint16>(static_cast<quint8>(buf[0]) | (static_cast<quint8>(buf[1]) << 8));
+}
+
+ProtocolUwsgi::ProtocolUwsgi(WSGI *wsgi) : Protocol(wsgi)
+{
+}
+
+ProtocolUwsgi::~ProtocolUwsgi()
+{
+}
+
+Protocol::Type ProtocolUwsgi::type() const
+{
+    return Uwsgi;
+}
+
+void ProtocolUwsgi::readyRead(Socket *sock, QIODevice *io) const
+{
+    // Post buffering
+    if (sock->connState == Socket::ContentBody) {
+        qint64 bytesAvailable = io->bytesAvailable();
+        int len;
+        qint64 remaining;
+
+        QIODevice *body = sock->body;
+        do {
+            remaining = sock->contentLength - body->size();
+            len = io->read(m_postBuffer, qMin(m_postBufferSize, remaining));
+            if (len == -1) {
+                sock->connectionClose();
+                return;
+            }
+            bytesAvailable -= len;
+            body->write(m_postBuffer, len);
+        } while (bytesAvailable && remaining != len);
+
+        if (remaining == len) {
+            processRequest(sock);
+        }
+        return;
+    }
+
+    int len = io->read(sock->buffer + sock->buf_size, m_bufferSize - sock->buf_size);
+    if (len == -1) {
+        qCWarning(CWSGI_UWSGI) << "Failed to read from socket" << io->errorString();
+        return;
+    }
+    sock->buf_size += len;
+
+    if (!sock->startOfRequest) {
+        sock->startOfRequest = sock->engine->time();
+    }
+
+    if (sock->buf_size < UWSGI_HEADER_LEN) {
+        // not enough data
+        return;
+    }
+
+    // modifier1 0 carries WSGI/CGI style variables, nginx's default
+    const quint8 modifier1 = static_cast<quint8>(sock->buffer[0]);
+    const quint16 pktsize = uwsgi_le16(sock->buffer + 1);
+    if (modifier1 != 0) {
+        qCWarning(CWSGI_UWSGI) << "Unsupported uwsgi modifier" << modifier1;
+        io->close();
+        return;
+    }
+
+    if (UWSGI_HEADER_LEN + pktsize > m_bufferSize) {
+        qCWarning(CWSGI_UWSGI) << "uwsgi packet of" << pktsize << "bytes is larger than the buffer, consider increasing buffer size";
+        io->close();
+        return;
+    }
+
+    if (sock->buf_size < UWSGI_HEADER_LEN + pktsize) {
+        // the whole packet must be buffered
+        return;
+    }
+
+    sock->contentLength = -1;
+    sock->headers = Cutelyst::Headers();
+    if (!parseVars(sock, sock->buffer + UWSGI_HEADER_LEN, pktsize)) {
+        qCWarning(CWSGI_UWSGI) << "Invalid uwsgi packet";
+        io->close();
+        return;
+    }
+
+    if (sock->contentLength > 0) {
+        if (!createBody(sock)) {
+            io->close();
+            return;
+        }
+
+        // Body data that came along with the packet
+        const qint64 buffered = qMin(sock->contentLength, static_cast<qint64>(sock->buf_size - UWSGI_HEADER_LEN - pktsize));
+        if (buffered) {
+            sock->body->write(sock->buffer + UWSGI_HEADER_LEN + pktsize, buffered);
+        }
+
+        if (sock->contentLength > buffered) {
+            // need to wait for more data
+            sock->connState = Socket::ContentBody;
+            if (io->bytesAvailable()) {
+                readyRead(sock, io);
+            }
+            return;
+        }
+    }
+
+    processRequest(sock);
+}
+
+bool ProtocolUwsgi::sendHeaders(QIODevice *io, Socket *sock, quint16 status, const QByteArray &dateHeader, const Cutelyst::Headers &headers)
+{
+    Q_UNUSED(sock)
+
+    static thread_local QByteArray headerBuffer = ([]() -> QByteArray {
+                                                       QByteArray ret;
+                                                       ret.reserve(1024);
+                                                       return ret;
+                                                   }());
+
+    int msgLen;
+    const char *msg = CWsgiEngine::httpStatusMessage(status, &msgLen);
+    headerBuffer.resize(0);
+    headerBuffer.append(msg, msgLen);
+
+    const auto headersData = headers.data();
+
+    bool hasDate = false;
+    auto it = headersData.constBegin();
+    const auto endIt = headersData.constEnd();
+    while (it != endIt) {
+        const QString key = it.key();
+        const QString value = it.value();
+        if (!hasDate && key == QLatin1String("DATE")) {
+            hasDate = true;
+        }
+
+        QString line(QLatin1String("\r\n") + CWsgiEngine::camelCaseHeader(key) + QLatin1String(": ") + value);
+        headerBuffer.append(line.toLatin1());
+
+        ++it;
+    }
+
+    if (!hasDate) {
+        headerBuffer.append(dateHeader);
+    }
+    headerBuffer.append("\r\n\r\n", 4);
+
+    return io->write(headerBuffer) == headerBuffer.size();
+}
+
+bool ProtocolUwsgi::parseVars(Socket *sock, const char *buf, quint16 len) const
+{
+    const char *end = buf + len;
+    while (buf < end) {
+        if (end - buf < 2) {
+            return false;
+        }
+        const quint16 keylen = uwsgi_le16(buf);
+        buf += 2;
+        if (end - buf < keylen + 2) {
+            return false;
+        }
+        const char *key = buf;
+        buf += keylen;
+
+        const quint16 vallen = uwsgi_le16(buf);
+        buf += 2;
+        if (end - buf < vallen) {
+            return false;
+        }
+
+        addVar(sock, key, keylen, buf, vallen);
+        buf += vallen;
+    }
+
+    return true;
+}
+
+void ProtocolUwsgi::addVar(Socket *sock, const char *key, quint16 keylen, const char *val, quint16 vallen) const
+{
+    if (keylen > 5 && memcmp(key, "HTTP_", 5) == 0) {
+        const QString value = QString::fromLatin1(val, vallen);
+        if (!sock->headerHost && keylen == 9 && memcmp(key + 5, "HOST", 4) == 0) {
+            sock->serverAddress = value;
+            sock->headerHost = true;
+            sock->headers.pushRawHeader(QStringLiteral("HOST"), value);
+        } else {
+            sock->headers.pushRawHeader(QString::fromLatin1(key + 5, keylen - 5), value);
+        }
+    } else if (keylen == 14 && memcmp(key, "REQUEST_METHOD", 14) == 0) {
+        sock->method = QString::fromLatin1(val, vallen);
+    } else if (keylen == 11 && memcmp(key, "REQUEST_URI", 11) == 0) {
+        // skip the leading slash
+        const int start = vallen && val[0] == '/' ? 1 : 0;
+        const char *pch = static_cast<const char *>(memchr(val, '?', vallen));
+        if (pch) {
+            const int pos = pch - val;
+            sock->path = QString::fromLatin1(val + start, pos - start);
+            sock->query = QByteArray(pch + 1, vallen - pos - 1);
+        } else {
+            sock->path = QString::fromLatin1(val + start, vallen - start);
+            sock->query = QByteArray();
+        }
+    } else if (keylen == 15 && memcmp(key, "SERVER_PROTOCOL", 15) == 0) {
+        sock->protocol = QString::fromLatin1(val, vallen);
+    } else if (keylen == 11 && memcmp(key, "REMOTE_ADDR", 11) == 0) {
+        sock->remoteAddress.setAddress(QString::fromLatin1(val, vallen));
+    } else if (keylen == 11 && memcmp(key, "REMOTE_PORT", 11) == 0) {
+        sock->remotePort = QByteArray(val, vallen).toUInt();
+    } else if (keylen == 12 && memcmp(key, "CONTENT_TYPE", 12) == 0) {
+        if (vallen) {
+            sock->headers.setContentType(QString::fromLatin1(val, vallen));
+        }
+    } else if (keylen == 14 && memcmp(key, "CONTENT_LENGTH", 14) == 0) {
+        bool ok;
+        const qint64 cl = QByteArray(val, vallen).toLongLong(&ok);
+        if (ok && cl >= 0) {
+            sock->contentLength = cl;
+        }
+    } else if (keylen == 14 && memcmp(key, "REQUEST_SCHEME", 14) == 0) {
+        sock->isSecure = vallen == 5 && memcmp(val, "https", 5) == 0;
+    } else if (keylen == 5 && memcmp(key, "HTTPS", 5) == 0) {
+        sock->isSecure = vallen == 2 && memcmp(val, "on", 2) == 0;
+    }
+}
+
+bool ProtocolUwsgi::createBody(Socket *sock) const
+{
+    if (m_postBuffering && sock->contentLength > m_postBuffering) {
+        auto temp = new QTemporaryFile;
+        if (!temp->open()) {
+            qCWarning(CWSGI_UWSGI) << "Failed to open temporary file to store post" << temp->errorString();
+            delete temp;
+            return false;
+        }
+        sock->body = temp;
+    } else {
+        auto buffer = new QBuffer;
+        buffer->open(QIODevice::ReadWrite);
+        // The length comes from the peer, don't trust it for allocations
+        buffer->buffer().reserve(static_cast<int>(qMin(sock->contentLength, m_postBufferSize)));
+        sock->body = buffer;
+    }
+    return true;
+}
+
+void ProtocolUwsgi::processRequest(Socket *sock) const
+{
+    sock->processing = true;
+    if (sock->body) {
+        sock->body->seek(0);
+    }
+
+    delete sock->engine->processSocket(sock);
+    sock->processing = false;
+
+    // uwsgi has one request per connection, the
+    // web server waits for it to be closed
+    sock->connectionClose();
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef PROTOCOLUWSGI_H
+#define PROTOCOLUWSGI_H
+
+#include <QObject>
+
+#include "protocol.h"
+
+namespace CWSGI {
+
+class WSGI;
+class Socket;
+/**
+ * Speaks the uwsgi binary protocol used by nginx's uwsgi_pass,
+ * a single packet of length prefixed variables followed by the
+ * request body, the response is plain HTTP.
+ */
+class ProtocolUwsgi : public Protocol
+{
+public:
+    ProtocolUwsgi(WSGI *wsgi);
+    virtual ~ProtocolUwsgi();
+
+    virtual Type type() const override;
+
+    virtual void readyRead(Socket *sock, QIODevice *io) const override;
+    virtual bool sendHeaders(QIODevice *io, Socket *sock, quint16 status, const QByteArray &dateHeader, const Cutelyst::Headers &headers) override;
+
+private:
+    inline bool parseVars(Socket *sock, const char *buf, quint16 len) const;
+    inline void addVar(Socket *sock, const char *key, quint16 keylen, const char *val, quint16 vallen) const;
+    inline bool createBody(Socket *sock) const;
+    inline void processRequest(Socket *sock) const;
+};
+
+}
+
+#endif // PROTOCOLUWSGI_H
@@ -20,6 +20,7 @@
 
 #include "socket.h"
 #include "wsgi.h"
+#include "websocketdeflate.h"
 
 #include <Cutelyst/Headers>
 #include <Cutelyst/Context>
@@ -27,14 +28,13 @@
 
 #include <QLoggingCategory>
 
-#include <QTextCodec>
+#include <limits>
 
 using namespace CWSGI;
 
 Q_LOGGING_CATEGORY(CWSGI_WS, "cwsgi.websocket")
 
 ProtocolWebSocket::ProtocolWebSocket(CWSGI::WSGI *wsgi) : Protocol(wsgi)
-  , m_codec(QTextCodec::codecForName(QByteArrayLiteral("UTF-8")))
 {
     m_websockets_max_size = wsgi->websocketMaxSize() * 1024;
 }
@@ -43,36 +43,38 @@ ProtocolWebSocket::~ProtocolWebSocket()
 {
 }
 
-QByteArray ProtocolWebSocket::createWebsocketHeader(quint8 opcode, quint64 len)
+int ProtocolWebSocket::writeWebsocketHeader(char *buf, quint8 opcode, quint64 len, bool compressed)
 {
-    QByteArray ret;
-    ret.append(0x80 + opcode);
+    // RSV1 marks a message compressed with permessage-deflate
+    buf[0] = static_cast<char>(0x80 + (compressed ? 0x40 : 0) + opcode);
 
     if (len < 126) {
-        ret.append(static_cast<quint8>(len));
+        buf[1] = static_cast<char>(len);
+        return 2;
     } else if (len <= static_cast<quint16>(0xffff)) {
-        ret.append(126);
-
-        quint8 buf[2];
-        buf[1] = (quint8) (len & 0xff);
-        buf[0] = (quint8) ((len >> 8) & 0xff);
-        ret.append(reinterpret_cast<char*>(buf), 2);
-    } else {
-        ret.append(127);
-
-        quint8 buf[8];
-        buf[7] = (quint8) (len & 0xff);
-        buf[6] = (quint8) ((len >> 8) & 0xff);
-        buf[5] = (quint8) ((len >> 16) & 0xff);
-        buf[4] = (quint8) ((len >> 24) & 0xff);
-        buf[3] = (quint8) ((len >> 32) & 0xff);
-        buf[2] = (quint8) ((len >> 40) & 0xff);
-        buf[1] = (quint8) ((len >> 48) & 0xff);
-        buf[0] = (quint8) ((len >> 56) & 0xff);
-        ret.append(reinterpret_cast<char*>(buf), 8);
+        buf[1] = 126;
+        buf[2] = static_cast<char>((len >> 8) & 0xff);
+        buf[3] = static_cast<char>(len & 0xff);
+        return 4;
     }
 
-    return ret;
+    buf[1] = 127;
+    buf[2] = static_cast<char>((len >> 56) & 0xff);
+    buf[3] = static_cast<char>((len >> 48) & 0xff);
+    buf[4] = static_cast<char>((len >> 40) & 0xff);
+    buf[5] = static_cast<char>((len >> 32) & 0xff);
+    buf[6] = static_cast<char>((len >> 24) & 0xff);
+    buf[7] = static_cast<char>((len >> 16) & 0xff);
+    buf[8] = static_cast<char>((len >> 8) & 0xff);
+    buf[9] = static_cast<char>(len & 0xff);
+    return 10;
+}
+
+QByteArray ProtocolWebSocket::createWebsocketHeader(quint8 opcode, quint64 len, bool compressed)
+{
+    char buf[WebsocketMaxHeaderSize];
+    const int size = writeWebsocketHeader(buf, opcode, len, compressed);
+    return QByteArray(buf, size);
 }
 
 QByteArray ProtocolWebSocket::createWebsocketCloseReply(const QString &msg, quint16 closeCode)
@@ -118,6 +120,78 @@ quint64 ws_be64(const char *buf) {
     return ret;
 }
 
+/**
+ * Validates UTF-8 that may end in the middle of a sequence, returns -1 on
+ * invalid data, otherwise the size of the complete sequences, what's left is
+ * the valid start of a sequence to be completed by the next chunk.
+ */
+static int websocket_utf8_complete(const char *data, int len)
+{
+    const quint8 *s = reinterpret_cast<const quint8 *>(data);
+    int i = 0;
+    while (i < len) {
+        // ASCII eight bytes at a time
+        if (len - i >= 8) {
+            quint64 word;
+            memcpy(&word, s + i, 8);
+            if (!(word & Q_UINT64_C(0x8080808080808080))) {
+                i += 8;
+                continue;
+            }
+        }
+
+        const quint8 c = s[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+
+        // Ranges of the second byte exclude overlong
+        // forms, surrogates and code points past U+10FFFF
+        int n;
+        quint8 lo = 0x80;
+        quint8 hi = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            n = 1;
+        } else if (c == 0xe0) {
+            n = 2;
+            lo = 0xa0;
+        } else if (c == 0xed) {
+            n = 2;
+            hi = 0x9f;
+        } else if (c >= 0xe1 && c <= 0xef) {
+            n = 2;
+        } else if (c == 0xf0) {
+            n = 3;
+            lo = 0x90;
+        } else if (c == 0xf4) {
+            n = 3;
+            hi = 0x8f;
+        } else if (c >= 0xf1 && c <= 0xf3) {
+            n = 3;
+        } else {
+            return -1;
+        }
+
+        const int available = qMin(n, len - i - 1);
+        if (available >= 1 && (s[i + 1] < lo || s[i + 1] > hi)) {
+            return -1;
+        }
+        for (int k = 2; k <= available; ++k) {
+            if ((s[i + k] & 0xc0) != 0x80) {
+                return -1;
+            }
+        }
+
+        if (available < n) {
+            return i;
+        }
+        i += n + 1;
+    }
+
+    return len;
+}
+
 void ProtocolWebSocket::readyRead(Socket *sock, QIODevice *io) const
 {
     qint64 bytesAvailable = io->bytesAvailable();
@@ -128,6 +202,42 @@ void ProtocolWebSocket::readyRead(Socket *sock, QIODevice *io) const
             return;
         }
 
+        if (sock->websocket_phase == Socket::WebSocketPhasePayload) {
+            if (sock->websocket_streaming && !(sock->websocket_finn_opcode & 0x8)) {
+                // Streamed data is handed over as it arrives
+                qint64 len = io->read(m_postBuffer, qMin(static_cast<qint64>(sock->websocket_need), qMin(bytesAvailable, m_postBufferSize)));
+                if (len == -1) {
+                    qCWarning(CWSGI_WS) << "Failed to read from socket" << io->errorString();
+                    sock->connectionClose();
+                    return;
+                }
+                bytesAvailable -= len;
+
+                if (!websocket_parse_payload(sock, m_postBuffer, len, io)) {
+                    return;
+                }
+                continue;
+            }
+
+            // The payload is read straight into its final buffer, data frames
+            // are appended to the message and control frames use their own
+            QByteArray &target = (sock->websocket_finn_opcode & 0x8) ? sock->websocket_payload : sock->websocket_message;
+            const quint32 received = sock->websocket_payload_size - sock->websocket_need;
+            char *data = target.data() + sock->websocket_start_of_payload + received;
+            qint64 len = io->read(data, qMin(static_cast<qint64>(sock->websocket_need), bytesAvailable));
+            if (len == -1) {
+                qCWarning(CWSGI_WS) << "Failed to read from socket" << io->errorString();
+                sock->connectionClose();
+                return;
+            }
+            bytesAvailable -= len;
+
+            if (!websocket_parse_payload(sock, data, len, io)) {
+                return;
+            }
+            continue;
+        }
+
         quint32 maxlen = qMin(sock->websocket_need, static_cast<quint32>(m_postBufferSize));
         qint64 len = io->read(m_postBuffer, maxlen);
         if (len == -1) {
@@ -151,11 +261,6 @@ void ProtocolWebSocket::readyRead(Socket *sock, QIODevice *io) const
         case Socket::WebSocketPhaseMask:
             websocket_parse_mask(sock, m_postBuffer, io);
             break;
-        case Socket::WebSocketPhasePayload:
-            if (!websocket_parse_payload(sock, m_postBuffer, len, io)) {
-                return;
-            }
-            break;
         }
     }
 }
@@ -175,45 +280,34 @@ bool ProtocolWebSocket::send_text(Cutelyst::Context *c, Socket *sock, bool singl
 {
     Cutelyst::Request *request = c->request();
 
-    const int msg_size = sock->websocket_message.size();
-    sock->websocket_message.append(sock->websocket_payload);
+    // The frame was read into the message, it's validated together with
+    // the start of a sequence the previous frame might have left
+    const char *data = sock->websocket_message.constData() + sock->websocket_start_of_frame;
+    const int size = sock->websocket_message.size() - sock->websocket_start_of_frame;
+    const bool lastFrame = sock->websocket_finn_opcode & 0x80;
 
-    QByteArray payload = sock->websocket_payload;
-    if (sock->websocket_start_of_frame != msg_size) {
-        payload = sock->websocket_message.mid(sock->websocket_start_of_frame);
-    }
-
-    QTextCodec::ConverterState state;
-    const QString frame = m_codec->toUnicode(payload.data(), payload.size(), &state);
-    const bool failed = state.invalidChars || state.remainingChars;
-    if (singleFrame && (failed || (frame.isEmpty() && payload.size()))) {
+    const int complete = websocket_utf8_complete(data, size);
+    if (complete < 0 || (lastFrame && complete != size)) {
         sock->connectionClose();
         return false;
-    } else if (!failed) {
-        sock->websocket_start_of_frame = sock->websocket_message.size();
-        request->webSocketTextFrame(frame,
-                                    sock->websocket_finn_opcode & 0x80,
-                                    sock->websocketContext);
     }
 
-    if (sock->websocket_finn_opcode & 0x80) {
+    sock->websocket_start_of_frame += complete;
+    const QString frame = QString::fromUtf8(data, complete);
+    request->webSocketTextFrame(frame,
+                                lastFrame,
+                                sock->websocketContext);
+
+    if (lastFrame) {
         sock->websocket_continue_opcode = 0;
-        if (singleFrame || sock->websocket_payload == sock->websocket_message) {
+        if (singleFrame || sock->websocket_start_of_payload == 0) {
             request->webSocketTextMessage(frame,
                                           sock->websocketContext);
         } else {
-            QTextCodec::ConverterState stateMsg;
-            const QString msg = m_codec->toUnicode(sock->websocket_message.data(), sock->websocket_message.size(), &stateMsg);
-            const bool failed = state.invalidChars || state.remainingChars;
-            if (failed) {
-                sock->connectionClose();
-                return false;
-            }
-            request->webSocketTextMessage(msg,
+            request->webSocketTextMessage(QString::fromUtf8(sock->websocket_message.constData(), sock->websocket_message.size()),
                                           sock->websocketContext);
         }
         sock->websocket_message = QByteArray();
-        sock->websocket_payload = QByteArray();
     }
 
     return true;
@@ -223,16 +317,15 @@ void ProtocolWebSocket::send_binary(Cutelyst::Context *c, Socket *sock, bool sin
 {
     Cutelyst::Request *request = c->request();
 
-    sock->websocket_message.append(sock->websocket_payload);
-
-    const QByteArray frame = sock->websocket_payload;
+    // A frame that is the whole message shares its buffer
+    const QByteArray frame = sock->websocket_start_of_payload ? sock->websocket_message.mid(sock->websocket_start_of_payload) : sock->websocket_message;
     request->webSocketBinaryFrame(frame,
                                   sock->websocket_finn_opcode & 0x80,
                                   sock->websocketContext);
 
     if (sock->websocket_finn_opcode & 0x80) {
         sock->websocket_continue_opcode = 0;
-        if (singleFrame || sock->websocket_payload == sock->websocket_message) {
+        if (singleFrame || sock->websocket_start_of_payload == 0) {
             request->webSocketBinaryMessage(frame,
                                             sock->websocketContext);
         } else {
@@ -240,7 +333,6 @@ void ProtocolWebSocket::send_binary(Cutelyst::Context *c, Socket *sock, bool sin
                                             sock->websocketContext);
         }
         sock->websocket_message = QByteArray();
-        sock->websocket_payload = QByteArray();
     }
 }
 
@@ -254,14 +346,18 @@ void ProtocolWebSocket::send_closed(Cutelyst::Context *c, Socket *sock, QIODevic
 {
     quint16 closeCode = Cutelyst::Response::CloseCodeMissingStatusCode;
     QString reason;
-    QTextCodec::ConverterState state;
+    bool validReason = true;
     if (sock->websocket_payload.size() >= 2) {
         closeCode = ws_be16(sock->websocket_payload.data());
-        reason = m_codec->toUnicode(sock->websocket_payload.data() + 2, sock->websocket_payload.size() - 2, &state);
+        const int size = sock->websocket_payload.size() - 2;
+        validReason = websocket_utf8_complete(sock->websocket_payload.constData() + 2, size) == size;
+        if (validReason) {
+            reason = QString::fromUtf8(sock->websocket_payload.constData() + 2, size);
+        }
     }
     c->request()->webSocketClosed(closeCode, reason);
 
-    if (state.invalidChars || state.remainingChars) {
+    if (!validReason) {
         reason = QString();
         closeCode = Cutelyst::Response::CloseCodeProtocolError;
     } else if (closeCode < 3000 || closeCode > 4999) {
@@ -310,10 +406,13 @@ bool ProtocolWebSocket::websocket_parse_header(Socket *sock, const char *buf, QI
 
     quint8 opcode = byte1 & 0xf;
 
+    // Only the first frame of a message may set RSV1, if compression was negotiated
+    const quint8 rsvMask = sock->websocket_deflate && (opcode == Socket::OpCodeText || opcode == Socket::OpCodeBinary) ? 0x30 : 0x70;
+
     bool websocket_has_mask = byte2 >> 7;
     if (!websocket_has_mask ||
             ((opcode == Socket::OpCodePing || opcode == Socket::OpCodeClose) && sock->websocket_payload_size > 125) ||
-            (byte1 & 0x70) ||
+            (byte1 & rsvMask) ||
             ((opcode >= Socket::OpCodeReserved3 && opcode <= Socket::OpCodeReserved7) ||
              (opcode >= Socket::OpCodeReservedB && opcode <= Socket::OpCodeReservedF)) ||
             (!(byte1 & 0x80) && opcode != Socket::OpCodeText && opcode != Socket::OpCodeBinary && opcode != Socket::OpCodeContinue) ||
@@ -335,6 +434,8 @@ bool ProtocolWebSocket::websocket_parse_header(Socket *sock, const char *buf, QI
     if (opcode == Socket::OpCodeText || opcode == Socket::OpCodeBinary) {
         sock->websocket_message = QByteArray();
         sock->websocket_start_of_frame = 0;
+        sock->websocket_compressed = byte1 & 0x40;
+        sock->websocket_streaming = !sock->websocket_compressed && sock->websocketContext->request()->webSocketStreaming();
         if (!(byte1 & 0x80)) {
             // FINN byte not set, store opcode for continue
             sock->websocket_continue_opcode = opcode;
@@ -368,8 +469,11 @@ bool ProtocolWebSocket::websocket_parse_size(Socket *sock, const char *buf, int
         return false;
     }
 
-    if (size > static_cast<quint64>(websockets_max_message_size)) {
-        qCCritical(CWSGI_WS) << "Payload size too big" << size << "max allowed" << websockets_max_message_size;
+    // Streamed frames are never held in memory as a whole
+    const quint64 maxSize = sock->websocket_streaming && !(sock->websocket_finn_opcode & 0x8) ?
+                static_cast<quint64>(std::numeric_limits<int>::max()) : static_cast<quint64>(websockets_max_message_size);
+    if (size > maxSize) {
+        qCCritical(CWSGI_WS) << "Payload size too big" << size << "max allowed" << maxSize;
         sock->connectionClose();
         return false;
     }
@@ -389,31 +493,95 @@ void ProtocolWebSocket::websocket_parse_mask(Socket *sock, char *buf, QIODevice
     sock->websocket_phase = Socket::WebSocketPhasePayload;
     sock->websocket_need = sock->websocket_payload_size;
 
-    sock->websocket_payload = QByteArray();
+    if (sock->websocket_finn_opcode & 0x8) {
+        // Control frames may come between the frames of a message
+        sock->websocket_start_of_payload = 0;
+        sock->websocket_payload = QByteArray(sock->websocket_payload_size, Qt::Uninitialized);
+    } else if (!sock->websocket_streaming) {
+        sock->websocket_start_of_payload = sock->websocket_message.size();
+        sock->websocket_message.resize(sock->websocket_start_of_payload + sock->websocket_payload_size);
+    }
+
     if (sock->websocket_payload_size == 0) {
         websocket_parse_payload(sock, buf, 0, io);
-    } else {
-        sock->websocket_payload.reserve(sock->websocket_payload_size);
+    }
+}
+
+static inline void websocket_unmask(char *data, uint len, quint32 mask, uint pos)
+{
+    const quint8 *maskBytes = reinterpret_cast<const quint8 *>(&mask);
+    quint8 *ptr = reinterpret_cast<quint8 *>(data);
+    quint8 *end = ptr + len;
+
+    // Single bytes until the data is aligned
+    while (ptr < end && (reinterpret_cast<quintptr>(ptr) & 7)) {
+        *ptr++ ^= maskBytes[pos++ & 3];
+    }
+
+    if (end - ptr >= 8) {
+        // The mask repeated on a word, starting at the current mask byte
+        quint8 maskWordBytes[8];
+        for (int i = 0; i < 8; ++i) {
+            maskWordBytes[i] = maskBytes[(pos + i) & 3];
+        }
+        quint64 maskWord;
+        memcpy(&maskWord, maskWordBytes, 8);
+
+        // Four words at a time which compilers vectorize
+        while (end - ptr >= 32) {
+            quint64 words[4];
+            memcpy(words, ptr, 32);
+            words[0] ^= maskWord;
+            words[1] ^= maskWord;
+            words[2] ^= maskWord;
+            words[3] ^= maskWord;
+            memcpy(ptr, words, 32);
+            ptr += 32;
+        }
+
+        while (end - ptr >= 8) {
+            quint64 word;
+            memcpy(&word, ptr, 8);
+            word ^= maskWord;
+            memcpy(ptr, &word, 8);
+            ptr += 8;
+        }
+    }
+
+    // Whole words don't change the mask position
+    while (ptr < end) {
+        *ptr++ ^= maskBytes[pos++ & 3];
     }
 }
 
 bool ProtocolWebSocket::websocket_parse_payload(Socket *sock, char *buf, uint len, QIODevice *io) const
 {
-    quint8 *mask = reinterpret_cast<quint8 *>(&sock->websocket_mask);
-    for (uint i = 0, maskIx = sock->websocket_payload.size(); i < len; ++i, ++maskIx) {
-        buf[i] = buf[i] ^ mask[maskIx % 4];
+    websocket_unmask(buf, len, sock->websocket_mask, sock->websocket_payload_size - sock->websocket_need);
+
+    sock->websocket_need -= len;
+    if (sock->websocket_streaming && !(sock->websocket_finn_opcode & 0x8)) {
+        return websocket_stream_payload(sock, buf, len, io);
     }
 
-    sock->websocket_payload.append(buf, len);
-    if (sock->websocket_payload.size() < sock->websocket_payload_size) {
+    if (sock->websocket_need) {
         // need more data
-        sock->websocket_need -= len;
         return true;
     }
 
     sock->websocket_need = 2;
     sock->websocket_phase = Socket::WebSocketPhaseHeaders;
 
+    if (sock->websocket_compressed && !(sock->websocket_finn_opcode & 0x8)) {
+        if (!(sock->websocket_finn_opcode & 0x80)) {
+            // Compressed frames can only be inflated as a whole message
+            return true;
+        }
+
+        if (!websocket_inflate_message(sock, io)) {
+            return false;
+        }
+    }
+
     Cutelyst::Request *request = sock->websocketContext->request();
 
     switch (sock->websocket_finn_opcode & 0xf) {
@@ -457,3 +625,87 @@ bool ProtocolWebSocket::websocket_parse_payload(Socket *sock, char *buf, uint le
 
     return true;
 }
+
+bool ProtocolWebSocket::websocket_inflate_message(Socket *sock, QIODevice *io) const
+{
+    QByteArray message;
+    const WebSocketDeflate::DecompressResult result = sock->websocket_deflate->decompress(sock->websocket_message, m_websockets_max_size, message);
+    if (result != WebSocketDeflate::DecompressOk) {
+        if (result == WebSocketDeflate::DecompressTooBig) {
+            qCCritical(CWSGI_WS) << "Inflated payload too big, max allowed" << m_websockets_max_size;
+            io->write(ProtocolWebSocket::createWebsocketCloseReply(QString(), Cutelyst::Response::CloseCodeTooMuchData));
+        } else {
+            io->write(ProtocolWebSocket::createWebsocketCloseReply(QString(), Cutelyst::Response::CloseCodeWrongDatatype));
+        }
+        sock->connectionClose();
+        return false;
+    }
+
+    // The frames are delivered as a single one holding the whole message
+    sock->websocket_message = message;
+    sock->websocket_start_of_frame = 0;
+    sock->websocket_start_of_payload = 0;
+    sock->websocket_compressed = false;
+
+    return true;
+}
+
+bool ProtocolWebSocket::websocket_stream_payload(Socket *sock, const char *buf, uint len, QIODevice *io) const
+{
+    const bool frameDone = sock->websocket_need == 0;
+    if (frameDone) {
+        sock->websocket_need = 2;
+        sock->websocket_phase = Socket::WebSocketPhaseHeaders;
+    }
+    const bool lastFrame = frameDone && (sock->websocket_finn_opcode & 0x80);
+
+    Cutelyst::Request *request = sock->websocketContext->request();
+
+    quint8 opcode = sock->websocket_finn_opcode & 0xf;
+    if (opcode == Socket::OpCodeContinue) {
+        opcode = sock->websocket_continue_opcode;
+    }
+    if (opcode != Socket::OpCodeText && opcode != Socket::OpCodeBinary) {
+        qCCritical(CWSGI_WS) << "Invalid CONTINUE opcode:" << (sock->websocket_finn_opcode & 0xf);
+        sock->connectionClose();
+        return false;
+    }
+
+    if (opcode == Socket::OpCodeBinary) {
+        if (len || lastFrame) {
+            request->webSocketBinaryFrame(QByteArray(buf, len),
+                                          lastFrame,
+                                          sock->websocketContext);
+        }
+    } else {
+        // The message only keeps a sequence split between chunks
+        const char *data = buf;
+        int size = len;
+        if (!sock->websocket_message.isEmpty()) {
+            sock->websocket_message.append(buf, len);
+            data = sock->websocket_message.constData();
+            size = sock->websocket_message.size();
+        }
+
+        const int complete = websocket_utf8_complete(data, size);
+        if (complete < 0 || (lastFrame && complete != size)) {
+            io->write(ProtocolWebSocket::createWebsocketCloseReply(QString(), Cutelyst::Response::CloseCodeWrongDatatype));
+            sock->connectionClose();
+            return false;
+        }
+
+        const QString text = QString::fromUtf8(data, complete);
+        sock->websocket_message = QByteArray(data + complete, size - complete);
+        if (complete || lastFrame) {
+            request->webSocketTextFrame(text,
+                                        lastFrame,
+                                        sock->websocketContext);
+        }
+    }
+
+    if (lastFrame) {
+        sock->websocket_continue_opcode = 0;
+    }
+
+    return true;
+}
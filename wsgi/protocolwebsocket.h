@@ -21,8 +21,6 @@
 
 #include "protocol.h"
 
-class QTextCodec;
-
 namespace CWSGI {
 
 class WSGI;
@@ -32,7 +30,16 @@ public:
     ProtocolWebSocket(WSGI *wsgi);
     ~ProtocolWebSocket();
 
-    static QByteArray createWebsocketHeader(quint8 opcode, quint64 len);
+    enum {
+        WebsocketMaxHeaderSize = 10
+    };
+
+    /**
+     * Writes the header of an unmasked frame to \p buf, which must hold
+     * WebsocketMaxHeaderSize bytes, and returns its size
+     */
+    static int writeWebsocketHeader(char *buf, quint8 opcode, quint64 len, bool compressed);
+    static QByteArray createWebsocketHeader(quint8 opcode, quint64 len, bool compressed = false);
     static QByteArray createWebsocketCloseReply(const QString &msg, quint16 closeCode);
 
     virtual void readyRead(Socket *sock, QIODevice *io) const override;
@@ -47,8 +54,9 @@ private:
     bool websocket_parse_size(Socket *sock, const char *buf, int websockets_max_message_size) const;
     void websocket_parse_mask(Socket *sock, char *buf, QIODevice *io) const;
     bool websocket_parse_payload(Socket *sock, char *buf, uint len, QIODevice *io) const;
+    bool websocket_inflate_message(Socket *sock, QIODevice *io) const;
+    bool websocket_stream_payload(Socket *sock, const char *buf, uint len, QIODevice *io) const;
 
-    QTextCodec *m_codec;
     quint32 m_websockets_max_size;
 };
 
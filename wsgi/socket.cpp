@@ -19,6 +19,7 @@
 #include "socket.h"
 
 #include "wsgi.h"
+#include "websocketdeflate.h"
 
 #include <Cutelyst/Context>
 
@@ -48,6 +49,8 @@ Socket::Socket(WSGI *wsgi)
 
 Socket::~Socket()
 {
+    qDeleteAll(fcgi_streams);
+    delete websocket_deflate;
     delete [] buffer;
 }
 
@@ -60,6 +63,11 @@ void TcpSocket::socketDisconnected()
 
         delete websocketContext;
         websocketContext = nullptr;
+
+        delete websocket_deflate;
+        websocket_deflate = nullptr;
+
+        engine->webSocketKeepAliveRemove(this);
     }
 
     if (!processing) {
@@ -90,6 +98,11 @@ void LocalSocket::socketDisconnected()
 
         delete websocketContext;
         websocketContext = nullptr;
+
+        delete websocket_deflate;
+        websocket_deflate = nullptr;
+
+        engine->webSocketKeepAliveRemove(this);
     }
 
     if (!processing) {
@@ -119,6 +132,11 @@ void SslSocket::socketDisconnected()
 
         delete websocketContext;
         websocketContext = nullptr;
+
+        delete websocket_deflate;
+        websocket_deflate = nullptr;
+
+        engine->webSocketKeepAliveRemove(this);
     }
 
     if (!processing) {
@@ -23,6 +23,7 @@
 #include <QSslSocket>
 #include <QLocalSocket>
 #include <QHostAddress>
+#include <QHash>
 #include <Cutelyst/Headers>
 #include <Cutelyst/Engine>
 
@@ -34,6 +35,31 @@ namespace CWSGI {
 
 class WSGI;
 class Protocol;
+class WebSocketDeflate;
+
+/**
+ * A FastCGI request multiplexed on a connection
+ * that is still receiving another request
+ */
+struct FastCgiStream : public Cutelyst::EngineRequest
+{
+    FastCgiStream() {
+        startOfRequest = 0;
+        body = nullptr;
+        requestPtr = nullptr;
+        remotePort = 0;
+        isSecure = false;
+    }
+    ~FastCgiStream() {
+        delete body;
+    }
+
+    qint64 contentLength = -1;
+    quint16 pktsize = 0;
+    bool headerHost = false;
+    bool keepConn = false;
+};
+
 class Socket : public Cutelyst::EngineRequest
 {
     Q_GADGET
@@ -100,6 +126,11 @@ public:
         timeout = false;
         delete body;
         body = nullptr;
+        fcgi_body = nullptr;
+        if (!fcgi_streams.isEmpty()) {
+            qDeleteAll(fcgi_streams);
+            fcgi_streams.clear();
+        }
     }
 
     virtual void connectionClose() = 0;
@@ -107,6 +138,7 @@ public:
     qint64 contentLength;
     CWsgiEngine *engine;
     Cutelyst::Context *websocketContext = nullptr;
+    WebSocketDeflate *websocket_deflate = nullptr;
     Protocol *proto;
     char *buffer;
     ParserState connState = MethodLine;
@@ -116,6 +148,8 @@ public:
     int beginLine = 0;
     HeaderConnection headerConnection = HeaderConnectionNotSet;
     quint16 pktsize = 0;// FGCI
+    QHash<quint16, FastCgiStream *> fcgi_streams;
+    QIODevice *fcgi_body = nullptr;// FCGI STDIN record being read
     bool headerHost = false;
     bool processing = false;
     bool timeout = false;
@@ -124,11 +158,20 @@ public:
     QByteArray websocket_payload;
     quint32 websocket_need;
     int websocket_start_of_frame = 0;
+    int websocket_start_of_payload = 0;
     int websocket_phase = 0;
     int websocket_payload_size;
     quint32 websocket_mask;
     quint8 websocket_continue_opcode = 0;
     quint8 websocket_finn_opcode;
+    bool websocket_compressed = false;
+    bool websocket_streaming = false;
+    bool websocket_ping_sent = false;
+
+    // WebSocketKeepAlive timing wheel
+    Socket *websocket_wheel_prev = nullptr;
+    Socket *websocket_wheel_next = nullptr;
+    int websocket_wheel_slot = -1;
 };
 
 class TcpSocket : public QTcpSocket, public Socket
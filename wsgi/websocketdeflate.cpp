@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include "websocketdeflate.h"
+
+#include <QStringList>
+#include <QLoggingCategory>
+
+#include <zlib.h>
+
+using namespace CWSGI;
+
+Q_LOGGING_CATEGORY(CWSGI_WS_DEFLATE, "cwsgi.websocket.deflate")
+
+namespace {
+
+// zlib silently uses 9 bits when deflating with 8
+const int MinWindowBits = 9;
+const int MaxWindowBits = 15;
+
+z_stream *createDeflate(int windowBits)
+{
+    auto z = new z_stream;
+    z->zalloc = Z_NULL;
+    z->zfree = Z_NULL;
+    z->opaque = Z_NULL;
+    // Negative window bits produce a raw deflate stream, the memory
+    // level follows the window so small windows are actually cheaper
+    if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -windowBits, qBound(1, windowBits - 7, 8), Z_DEFAULT_STRATEGY) != Z_OK) {
+        qCWarning(CWSGI_WS_DEFLATE) << "Failed to initialize deflate" << windowBits;
+        delete z;
+        return nullptr;
+    }
+    return z;
+}
+
+z_stream *createInflate(int windowBits)
+{
+    auto z = new z_stream;
+    z->zalloc = Z_NULL;
+    z->zfree = Z_NULL;
+    z->opaque = Z_NULL;
+    z->next_in = Z_NULL;
+    z->avail_in = 0;
+    if (inflateInit2(z, -windowBits) != Z_OK) {
+        qCWarning(CWSGI_WS_DEFLATE) << "Failed to initialize inflate" << windowBits;
+        delete z;
+        return nullptr;
+    }
+    return z;
+}
+
+void destroyDeflate(z_stream *z)
+{
+    if (z) {
+        deflateEnd(z);
+        delete z;
+    }
+}
+
+void destroyInflate(z_stream *z)
+{
+    if (z) {
+        inflateEnd(z);
+        delete z;
+    }
+}
+
+// Streams of the connections without context takeover, they are
+// reset after each message so the thread needs only one per window size
+struct SharedStreams
+{
+    ~SharedStreams() {
+        for (z_stream *z : deflate) {
+            destroyDeflate(z);
+        }
+        for (z_stream *z : inflate) {
+            destroyInflate(z);
+        }
+    }
+
+    z_stream *deflate[MaxWindowBits + 1] = {};
+    z_stream *inflate[MaxWindowBits + 1] = {};
+};
+
+thread_local SharedStreams sharedStreams;
+
+enum Param {
+    ServerNoContextTakeover = 0x1,
+    ClientNoContextTakeover = 0x2,
+    ServerMaxWindowBits = 0x4,
+    ClientMaxWindowBits = 0x8
+};
+
+}
+
+WebSocketDeflate::~WebSocketDeflate()
+{
+    destroyDeflate(m_deflate);
+    destroyInflate(m_inflate);
+}
+
+WebSocketDeflate *WebSocketDeflate::negotiate(const QString &offers, int windowBits, bool noContextTakeover, QString *response)
+{
+    windowBits = qBound(MinWindowBits, windowBits, MaxWindowBits);
+
+    const QVector<QStringRef> extensions = offers.splitRef(QLatin1Char(','));
+    for (const QStringRef &extension : extensions) {
+        const QVector<QStringRef> parts = extension.split(QLatin1Char(';'));
+        if (parts.first().trimmed() != QLatin1String("permessage-deflate")) {
+            continue;
+        }
+
+        int seen = 0;
+        bool valid = true;
+        int serverBits = MaxWindowBits;
+        int clientBits = MaxWindowBits;
+        for (int i = 1; i < parts.size() && valid; ++i) {
+            const QStringRef param = parts.at(i).trimmed();
+            const int equal = param.indexOf(QLatin1Char('='));
+            const QStringRef name = equal == -1 ? param : param.left(equal).trimmed();
+            QStringRef value = equal == -1 ? QStringRef() : param.mid(equal + 1).trimmed();
+            if (value.size() >= 2 && value.startsWith(QLatin1Char('"')) && value.endsWith(QLatin1Char('"'))) {
+                value = value.mid(1, value.size() - 2);
+            }
+
+            int flag;
+            if (name == QLatin1String("server_no_context_takeover")) {
+                flag = ServerNoContextTakeover;
+                valid = value.isNull();
+            } else if (name == QLatin1String("client_no_context_takeover")) {
+                flag = ClientNoContextTakeover;
+                valid = value.isNull();
+            } else if (name == QLatin1String("server_max_window_bits")) {
+                flag = ServerMaxWindowBits;
+                serverBits = value.toInt(&valid);
+                valid = valid && serverBits >= 8 && serverBits <= MaxWindowBits;
+            } else if (name == QLatin1String("client_max_window_bits")) {
+                flag = ClientMaxWindowBits;
+                if (!value.isNull()) {
+                    clientBits = value.toInt(&valid);
+                    valid = valid && clientBits >= 8 && clientBits <= MaxWindowBits;
+                }
+            } else {
+                qCDebug(CWSGI_WS_DEFLATE) << "Unknown permessage-deflate parameter" << name;
+                valid = false;
+                break;
+            }
+
+            valid = valid && !(seen & flag);
+            seen |= flag;
+        }
+
+        // Our window can't go lower than zlib allows
+        serverBits = qMin(serverBits, windowBits);
+        if (!valid || serverBits < MinWindowBits) {
+            continue;
+        }
+
+        auto deflate = new WebSocketDeflate;
+        deflate->m_serverNoContextTakeover = noContextTakeover || (seen & ServerNoContextTakeover);
+        deflate->m_clientNoContextTakeover = noContextTakeover || (seen & ClientNoContextTakeover);
+        deflate->m_serverMaxWindowBits = serverBits;
+
+        QString ret = QStringLiteral("permessage-deflate");
+        if (deflate->m_serverNoContextTakeover) {
+            ret.append(QLatin1String("; server_no_context_takeover"));
+        }
+        if (deflate->m_clientNoContextTakeover) {
+            ret.append(QLatin1String("; client_no_context_takeover"));
+        }
+        if (serverBits < MaxWindowBits) {
+            ret.append(QLatin1String("; server_max_window_bits=") + QString::number(serverBits));
+        }
+
+        // The client window can only be limited if the client said it supports it,
+        // a window smaller than ours is still inflated with the minimum zlib has
+        if ((seen & ClientMaxWindowBits) && windowBits < clientBits) {
+            clientBits = windowBits;
+            ret.append(QLatin1String("; client_max_window_bits=") + QString::number(clientBits));
+        }
+        deflate->m_clientMaxWindowBits = qMax(clientBits, MinWindowBits);
+
+        *response = ret;
+        return deflate;
+    }
+
+    return nullptr;
+}
+
+bool WebSocketDeflate::compress(const char *data, int len, QByteArray &out)
+{
+    z_stream *z = deflater();
+    if (!z) {
+        return false;
+    }
+
+    z->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    z->avail_in = static_cast<uInt>(len);
+
+    out.resize(static_cast<int>(deflateBound(z, static_cast<uLong>(len))) + 8);
+    int written = 0;
+    Q_FOREVER {
+        z->next_out = reinterpret_cast<Bytef *>(out.data() + written);
+        z->avail_out = static_cast<uInt>(out.size() - written);
+
+        const int ret = ::deflate(z, Z_SYNC_FLUSH);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            qCWarning(CWSGI_WS_DEFLATE) << "Failed to deflate message" << ret;
+            deflateReset(z);
+            return false;
+        }
+        written = out.size() - static_cast<int>(z->avail_out);
+
+        // The flush is complete once deflate leaves output space unused
+        if (z->avail_out) {
+            break;
+        }
+        out.resize(out.size() * 2);
+    }
+
+    // Drop the empty stored block the sync flush ends with
+    out.resize(written - 4);
+
+    if (m_serverNoContextTakeover) {
+        deflateReset(z);
+    }
+
+    return true;
+}
+
+WebSocketDeflate::DecompressResult WebSocketDeflate::decompress(QByteArray &data, int maxSize, QByteArray &out)
+{
+    z_stream *z = inflater();
+    if (!z) {
+        return DecompressError;
+    }
+
+    data.append("\x00\x00\xff\xff", 4);
+    z->next_in = reinterpret_cast<Bytef *>(data.data());
+    z->avail_in = static_cast<uInt>(data.size());
+
+    // Never allocate more than one byte past the limit, which is how
+    // a message that is too big is detected
+    out.resize(qMin(data.size() * 4 + 64, maxSize + 1));
+    int written = 0;
+    int ret;
+    Q_FOREVER {
+        z->next_out = reinterpret_cast<Bytef *>(out.data() + written);
+        z->avail_out = static_cast<uInt>(out.size() - written);
+
+        ret = inflate(z, Z_SYNC_FLUSH);
+        written = out.size() - static_cast<int>(z->avail_out);
+        if (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && z->avail_out)) {
+            break;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            qCDebug(CWSGI_WS_DEFLATE) << "Failed to inflate message" << ret;
+            inflateReset(z);
+            return DecompressError;
+        } else if (z->avail_out) {
+            // All input was consumed and flushed
+            break;
+        } else if (written > maxSize) {
+            inflateReset(z);
+            return DecompressTooBig;
+        }
+        out.resize(qMin(out.size() * 2, maxSize + 1));
+    }
+
+    if (written > maxSize) {
+        inflateReset(z);
+        return DecompressTooBig;
+    }
+    out.resize(written);
+
+    // A final block ends the stream, the next message starts a new one
+    if (m_clientNoContextTakeover || ret == Z_STREAM_END) {
+        inflateReset(z);
+    }
+
+    return DecompressOk;
+}
+
+z_stream *WebSocketDeflate::deflater()
+{
+    if (m_deflate) {
+        return m_deflate;
+    }
+
+    if (m_serverNoContextTakeover) {
+        z_stream *&shared = sharedStreams.deflate[m_serverMaxWindowBits];
+        if (!shared) {
+            shared = createDeflate(m_serverMaxWindowBits);
+        }
+        return shared;
+    }
+
+    m_deflate = createDeflate(m_serverMaxWindowBits);
+    return m_deflate;
+}
+
+z_stream *WebSocketDeflate::inflater()
+{
+    if (m_inflate) {
+        return m_inflate;
+    }
+
+    if (m_clientNoContextTakeover) {
+        z_stream *&shared = sharedStreams.inflate[m_clientMaxWindowBits];
+        if (!shared) {
+            shared = createInflate(m_clientMaxWindowBits);
+        }
+        return shared;
+    }
+
+    m_inflate = createInflate(m_clientMaxWindowBits);
+    return m_inflate;
+}
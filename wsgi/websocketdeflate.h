@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef WEBSOCKETDEFLATE_H
+#define WEBSOCKETDEFLATE_H
+
+#include <QByteArray>
+#include <QString>
+
+typedef struct z_stream_s z_stream;
+
+namespace CWSGI {
+
+/**
+ * The permessage-deflate extension (RFC 7692) state of a single connection.
+ *
+ * The zlib streams are only allocated once the first compressed message
+ * goes through, and when context takeover is disabled for a direction all
+ * connections of the thread share one stream, so that idle connections
+ * don't keep a compression window.
+ */
+class WebSocketDeflate
+{
+public:
+    ~WebSocketDeflate();
+
+    /**
+     * Picks the first acceptable permessage-deflate offer from the
+     * Sec-WebSocket-Extensions request header \p offers, our window is
+     * limited to \p windowBits and \p noContextTakeover requests both sides to
+     * reset their context after each message.
+     *
+     * Returns nullptr if no offer was accepted, otherwise \p response is set
+     * to the value of the Sec-WebSocket-Extensions response header.
+     */
+    static WebSocketDeflate *negotiate(const QString &offers, int windowBits, bool noContextTakeover, QString *response);
+
+    /**
+     * Compresses a whole message into \p out, without the trailing
+     * 0x00 0x00 0xff 0xff of the sync flush.
+     */
+    bool compress(const char *data, int len, QByteArray &out);
+
+    enum DecompressResult {
+        DecompressOk,
+        DecompressError,
+        DecompressTooBig
+    };
+
+    /**
+     * Decompresses the whole message \p data into \p out, which must not grow
+     * past \p maxSize bytes, \p data is modified.
+     */
+    DecompressResult decompress(QByteArray &data, int maxSize, QByteArray &out);
+
+private:
+    WebSocketDeflate() = default;
+
+    z_stream *deflater();
+    z_stream *inflater();
+
+    z_stream *m_deflate = nullptr;
+    z_stream *m_inflate = nullptr;
+    int m_serverMaxWindowBits = 15;
+    int m_clientMaxWindowBits = 15;
+    bool m_serverNoContextTakeover = false;
+    bool m_clientNoContextTakeover = false;
+};
+
+}
+
+#endif // WEBSOCKETDEFLATE_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include "websocketkeepalive.h"
+
+#include "cwsgiengine.h"
+#include "socket.h"
+
+#include <QLoggingCategory>
+
+using namespace CWSGI;
+
+Q_LOGGING_CATEGORY(CWSGI_WS_KEEPALIVE, "cwsgi.websocket.keepalive")
+
+WebSocketKeepAlive::WebSocketKeepAlive(int pingInterval, int pongTimeout, CWsgiEngine *engine) : QObject(engine)
+  , m_timer(this)
+  , m_engine(engine)
+  , m_pingInterval(qMax(1, pingInterval))
+  , m_pongTimeout(qMax(1, pongTimeout))
+{
+    // Delays never reach a full turn, so a socket is never
+    // scheduled on the slot being processed
+    m_slots.resize(qMax(m_pingInterval, m_pongTimeout) + 1, nullptr);
+
+    m_timer.setInterval(1000);
+    connect(&m_timer, &QTimer::timeout, this, &WebSocketKeepAlive::tick);
+}
+
+void WebSocketKeepAlive::add(Socket *sock)
+{
+    if (sock->websocket_wheel_slot != -1) {
+        return;
+    }
+
+    sock->websocket_ping_sent = false;
+    sock->timeout = true;
+    schedule(sock, m_pingInterval);
+
+    if (++m_count == 1) {
+        m_timer.start();
+    }
+}
+
+void WebSocketKeepAlive::remove(Socket *sock)
+{
+    if (sock->websocket_wheel_slot == -1) {
+        return;
+    }
+
+    unlink(sock);
+
+    if (--m_count == 0) {
+        m_timer.stop();
+    }
+}
+
+void WebSocketKeepAlive::schedule(Socket *sock, int seconds)
+{
+    const int slot = (m_current + seconds) % static_cast<int>(m_slots.size());
+    Socket *&head = m_slots[slot];
+
+    sock->websocket_wheel_slot = slot;
+    sock->websocket_wheel_prev = nullptr;
+    sock->websocket_wheel_next = head;
+    if (head) {
+        head->websocket_wheel_prev = sock;
+    }
+    head = sock;
+}
+
+void WebSocketKeepAlive::unlink(Socket *sock)
+{
+    if (sock->websocket_wheel_prev) {
+        sock->websocket_wheel_prev->websocket_wheel_next = sock->websocket_wheel_next;
+    } else {
+        m_slots[sock->websocket_wheel_slot] = sock->websocket_wheel_next;
+    }
+
+    if (sock->websocket_wheel_next) {
+        sock->websocket_wheel_next->websocket_wheel_prev = sock->websocket_wheel_prev;
+    }
+
+    sock->websocket_wheel_prev = nullptr;
+    sock->websocket_wheel_next = nullptr;
+    sock->websocket_wheel_slot = -1;
+}
+
+void WebSocketKeepAlive::tick()
+{
+    m_current = (m_current + 1) % static_cast<int>(m_slots.size());
+
+    // Detach the whole slot first, closing a socket
+    // removes it from the wheel synchronously
+    Socket *sock = m_slots[m_current];
+    m_slots[m_current] = nullptr;
+    for (Socket *it = sock; it; it = it->websocket_wheel_next) {
+        it->websocket_wheel_slot = -1;
+    }
+
+    while (sock) {
+        Socket *next = sock->websocket_wheel_next;
+        sock->websocket_wheel_prev = nullptr;
+        sock->websocket_wheel_next = nullptr;
+        if (next) {
+            next->websocket_wheel_prev = nullptr;
+        }
+
+        if (!sock->timeout) {
+            // Data arrived, be it a pong or a message
+            sock->websocket_ping_sent = false;
+            sock->timeout = true;
+            schedule(sock, m_pingInterval);
+        } else if (sock->websocket_ping_sent) {
+            qCDebug(CWSGI_WS_KEEPALIVE) << "Closing WebSocket connection that didn't answer a ping";
+            --m_count;
+            sock->connectionClose();
+        } else {
+            sock->websocket_ping_sent = true;
+            schedule(sock, m_pongTimeout);
+            m_engine->webSocketSendPing(sock->websocketContext, QByteArray());
+        }
+
+        sock = next;
+    }
+
+    if (m_count == 0) {
+        m_timer.stop();
+    }
+}
+
+#include "moc_websocketkeepalive.cpp"
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 Daniel Nicoletti <dantti12@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB. If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef WEBSOCKETKEEPALIVE_H
+#define WEBSOCKETKEEPALIVE_H
+
+#include <QObject>
+#include <QTimer>
+
+#include <vector>
+
+namespace CWSGI {
+
+class Socket;
+class CWsgiEngine;
+
+/**
+ * Pings idle WebSocket connections of an engine and closes the ones
+ * that don't answer in time.
+ *
+ * Sockets sit on a timing wheel with one slot per second, linked through
+ * their own fields, so a single timer serves all connections and each
+ * tick only looks at the sockets due on it. Any data read from a socket
+ * clears its timeout flag, which counts as activity.
+ */
+class WebSocketKeepAlive : public QObject
+{
+    Q_OBJECT
+public:
+    WebSocketKeepAlive(int pingInterval, int pongTimeout, CWsgiEngine *engine);
+
+    /**
+     * Starts watching an upgraded socket
+     */
+    void add(Socket *sock);
+
+    /**
+     * Stops watching \p sock, does nothing if it's not being watched
+     */
+    void remove(Socket *sock);
+
+private:
+    void schedule(Socket *sock, int seconds);
+    void unlink(Socket *sock);
+    void tick();
+
+    std::vector<Socket *> m_slots;
+    QTimer m_timer;
+    CWsgiEngine *m_engine;
+    int m_pingInterval;
+    int m_pongTimeout;
+    int m_current = 0;
+    int m_count = 0;
+};
+
+}
+
+#endif // WEBSOCKETKEEPALIVE_H
@@ -21,6 +21,7 @@
 #include "protocol.h"
 #include "protocolhttp.h"
 #include "protocolfastcgi.h"
+#include "protocoluwsgi.h"
 #include "cwsgiengine.h"
 #include "socket.h"
 #include "tcpserverbalancer.h"
@@ -79,6 +80,7 @@ WSGI::~WSGI()
 
     delete d->protoHTTP;
     delete d->protoFCGI;
+    delete d->protoUWSGI;
 
     std::cout << "Cutelyst-WSGI terminated" << std::endl;
 }
@@ -167,6 +169,11 @@ void WSGI::parseCommandLine(const QStringList &arguments)
                                         QCoreApplication::translate("main", "address"));
     parser.addOption(fastcgiSocketOpt);
 
+    QCommandLineOption uwsgiSocketOpt(QStringLiteral("uwsgi-socket"),
+                                      QCoreApplication::translate("main", "bind to the specified UNIX/TCP socket using uwsgi protocol"),
+                                      QCoreApplication::translate("main", "address"));
+    parser.addOption(uwsgiSocketOpt);
+
     QCommandLineOption socketAccess(QStringLiteral("socket-access"),
                                     QCoreApplication::translate("main", "set the LOCAL socket access, such as 'ugo' standing for User, Group, Other access"),
                                     QCoreApplication::translate("main", "options"));
@@ -219,6 +226,29 @@ void WSGI::parseCommandLine(const QStringList &arguments)
                                  QCoreApplication::translate("main", "Kbytes"));
     parser.addOption(wsMaxSize);
 
+    QCommandLineOption wsCompression(QStringLiteral("websocket-compression"),
+                                     QCoreApplication::translate("main", "enable permessage-deflate websocket compression"));
+    parser.addOption(wsCompression);
+
+    QCommandLineOption wsCompressionWindowBits(QStringLiteral("websocket-compression-window-bits"),
+                                               QCoreApplication::translate("main", "maximum websocket compression window (9 to 15)"),
+                                               QCoreApplication::translate("main", "bits"));
+    parser.addOption(wsCompressionWindowBits);
+
+    QCommandLineOption wsCompressionNoContextTakeover(QStringLiteral("websocket-compression-no-context-takeover"),
+                                                      QCoreApplication::translate("main", "reset the websocket compression context after each message"));
+    parser.addOption(wsCompressionNoContextTakeover);
+
+    QCommandLineOption wsPingInterval(QStringLiteral("websocket-ping-interval"),
+                                      QCoreApplication::translate("main", "ping websocket connections idle for this long"),
+                                      QCoreApplication::translate("main", "seconds"));
+    parser.addOption(wsPingInterval);
+
+    QCommandLineOption wsPongTimeout(QStringLiteral("websocket-pong-timeout"),
+                                     QCoreApplication::translate("main", "close websocket connections not answering a ping within this time"),
+                                     QCoreApplication::translate("main", "seconds"));
+    parser.addOption(wsPongTimeout);
+
     QCommandLineOption pidfileOpt(QStringLiteral("pidfile"),
                                   QCoreApplication::translate("main", "create pidfile (before privileges drop)"),
                                   QCoreApplication::translate("main", "file"));
@@ -448,12 +478,49 @@ void WSGI::parseCommandLine(const QStringList &arguments)
         }
     }
 
+    if (parser.isSet(wsCompression)) {
+        setWebsocketCompression(true);
+    }
+
+    if (parser.isSet(wsCompressionWindowBits)) {
+        bool ok;
+        auto bits = parser.value(wsCompressionWindowBits).toInt(&ok);
+        setWebsocketCompressionWindowBits(bits);
+        if (!ok || bits < 9 || bits > 15) {
+            parser.showHelp(1);
+        }
+    }
+
+    if (parser.isSet(wsCompressionNoContextTakeover)) {
+        setWebsocketCompressionNoContextTakeover(true);
+    }
+
+    if (parser.isSet(wsPingInterval)) {
+        bool ok;
+        auto seconds = parser.value(wsPingInterval).toInt(&ok);
+        setWebsocketPingInterval(seconds);
+        if (!ok || seconds < 0) {
+            parser.showHelp(1);
+        }
+    }
+
+    if (parser.isSet(wsPongTimeout)) {
+        bool ok;
+        auto seconds = parser.value(wsPongTimeout).toInt(&ok);
+        setWebsocketPongTimeout(seconds);
+        if (!ok || seconds < 1) {
+            parser.showHelp(1);
+        }
+    }
+
     setHttpSocket(httpSocket() + parser.values(httpSocketOpt));
 
     setHttpsSocket(httpsSocket() + parser.values(httpsSocketOpt));
 
     setFastcgiSocket(fastcgiSocket() + parser.values(fastcgiSocketOpt));
 
+    setUwsgiSocket(uwsgiSocket() + parser.values(uwsgiSocketOpt));
+
     setStaticMap(staticMap() + parser.values(staticMapOpt));
 
     setStaticMap2(staticMap2() + parser.values(staticMap2Opt));
@@ -600,6 +667,17 @@ void WSGIPrivate::listenTcpSockets()
             listenTcp(socket, protoFCGI, false);
         }
     }
+
+    if (!uwsgiSockets.isEmpty()) {
+        if (!protoUWSGI) {
+            protoUWSGI = new ProtocolUwsgi(q);
+        }
+
+        const auto sockets = uwsgiSockets;
+        for (const auto &socket : sockets) {
+            listenTcp(socket, protoUWSGI, false);
+        }
+    }
 }
 
 bool WSGIPrivate::listenTcp(const QString &line, Protocol *protocol, bool secure)
@@ -630,6 +708,7 @@ void WSGIPrivate::listenLocalSockets()
 
     QStringList http = httpsSockets;
     QStringList fastcgi = fastcgiSockets;
+    QStringList uwsgi = uwsgiSockets;
 
     if (!http.isEmpty() && !protoHTTP) {
         protoHTTP = new ProtocolHttp(q);
@@ -639,6 +718,10 @@ void WSGIPrivate::listenLocalSockets()
         protoFCGI = new ProtocolFastCGI(q);
     }
 
+    if (!uwsgi.isEmpty() && !protoUWSGI) {
+        protoUWSGI = new ProtocolUwsgi(q);
+    }
+
 #ifdef Q_OS_LINUX
     std::vector<int> fds = systemdNotify::listenFds();
     for (int fd : fds) {
@@ -652,6 +735,8 @@ void WSGIPrivate::listenLocalSockets()
                 protocol = protoHTTP;
             } else if (fastcgi.removeOne(fullName)  || fastcgi.removeOne(name)) {
                 protocol = protoFCGI;
+            } else if (uwsgi.removeOne(fullName) || uwsgi.removeOne(name)) {
+                protocol = protoUWSGI;
             } else {
                 qFatal("systemd activated socket does not match any configured socket");
             }
@@ -680,6 +765,11 @@ void WSGIPrivate::listenLocalSockets()
     for (const auto &socket : fastcgiConst) {
         listenLocal(socket, protoFCGI);
     }
+
+    const auto uwsgiConst = uwsgi;
+    for (const auto &socket : uwsgiConst) {
+        listenLocal(socket, protoUWSGI);
+    }
 }
 
 bool WSGIPrivate::listenLocal(const QString &line, Protocol *protocol)
@@ -831,6 +921,18 @@ QStringList WSGI::fastcgiSocket() const
     return d->fastcgiSockets;
 }
 
+void WSGI::setUwsgiSocket(const QStringList &uwsgiSocket)
+{
+    Q_D(WSGI);
+    d->uwsgiSockets = uwsgiSocket;
+}
+
+QStringList WSGI::uwsgiSocket() const
+{
+    Q_D(const WSGI);
+    return d->uwsgiSockets;
+}
+
 void WSGI::setSocketAccess(const QString &socketAccess)
 {
     Q_D(WSGI);
@@ -1059,6 +1161,66 @@ int WSGI::websocketMaxSize() const
     return d->websocketMaxSize / 1024;
 }
 
+void WSGI::setWebsocketCompression(bool enable)
+{
+    Q_D(WSGI);
+    d->websocketCompression = enable;
+}
+
+bool WSGI::websocketCompression() const
+{
+    Q_D(const WSGI);
+    return d->websocketCompression;
+}
+
+void WSGI::setWebsocketCompressionWindowBits(int bits)
+{
+    Q_D(WSGI);
+    d->websocketCompressionWindowBits = qBound(9, bits, 15);
+}
+
+int WSGI::websocketCompressionWindowBits() const
+{
+    Q_D(const WSGI);
+    return d->websocketCompressionWindowBits;
+}
+
+void WSGI::setWebsocketCompressionNoContextTakeover(bool enable)
+{
+    Q_D(WSGI);
+    d->websocketCompressionNoContextTakeover = enable;
+}
+
+bool WSGI::websocketCompressionNoContextTakeover() const
+{
+    Q_D(const WSGI);
+    return d->websocketCompressionNoContextTakeover;
+}
+
+void WSGI::setWebsocketPingInterval(int seconds)
+{
+    Q_D(WSGI);
+    d->websocketPingInterval = seconds;
+}
+
+int WSGI::websocketPingInterval() const
+{
+    Q_D(const WSGI);
+    return d->websocketPingInterval;
+}
+
+void WSGI::setWebsocketPongTimeout(int seconds)
+{
+    Q_D(WSGI);
+    d->websocketPongTimeout = seconds;
+}
+
+int WSGI::websocketPongTimeout() const
+{
+    Q_D(const WSGI);
+    return d->websocketPongTimeout;
+}
+
 void WSGI::setPidfile(const QString &file)
 {
     Q_D(WSGI);
@@ -1287,6 +1449,13 @@ void WSGIPrivate::postFork(int workerId)
 
     Q_EMIT postForked(workerId);
 
+    // A single timer per process formats the Date header for all engines
+    CWsgiEngine::updateDateHeader();
+    auto dateTimer = new QTimer(this);
+    dateTimer->setTimerType(Qt::PreciseTimer);
+    connect(dateTimer, &QTimer::timeout, &CWsgiEngine::updateDateHeader);
+    dateTimer->start(1000);
+
     QTimer::singleShot(1000, this, [=]() {
         // THIS IS NEEDED when
         // --master --threads N --experimental-thread-balancer
@@ -1317,7 +1486,10 @@ CWsgiEngine *WSGIPrivate::createEngine(Application *app, int core)
 {
     Q_Q(WSGI);
 
-    auto engine = new CWsgiEngine(app, core, opt, q);
+    // Multipart bodies are read with the same buffer size used to read them from the socket
+    QVariantMap engineOpt = opt;
+    engineOpt.insert(QStringLiteral("post_buffering_bufsize"), postBufferingBufsize);
+    auto engine = new CWsgiEngine(app, core, engineOpt, q);
     connect(this, &WSGIPrivate::shutdown, engine, &CWsgiEngine::shutdown, Qt::QueuedConnection);
     connect(this, &WSGIPrivate::postForked, engine, &CWsgiEngine::postFork, Qt::QueuedConnection);
     connect(engine, &CWsgiEngine::shutdownCompleted, this, &WSGIPrivate::engineShutdown, Qt::QueuedConnection);
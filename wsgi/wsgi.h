@@ -123,6 +123,15 @@ public:
     void setFastcgiSocket(const QStringList &fastcgiSocket);
     QStringList fastcgiSocket() const;
 
+    /**
+     * Defines how an uwsgi socket should be binded, for use with web servers
+     * that speak the uwsgi protocol like nginx's uwsgi_pass
+     * @accessors uwsgiSocket(), setUwsgiSocket()
+     */
+    Q_PROPERTY(QStringList uwsgi_socket READ uwsgiSocket WRITE setUwsgiSocket)
+    void setUwsgiSocket(const QStringList &uwsgiSocket);
+    QStringList uwsgiSocket() const;
+
     /**
      * Defines the file permissions of a local socket, u = user, g = group, o = others
      * @accessors socketAccess(), setSocketAccess()
@@ -222,7 +231,7 @@ public:
     qint64 postBuffering() const;
 
     /**
-     * Defines the buffer size when reading a POST request
+     * Defines the buffer size when reading a POST request, 64KiB by default
      * @accessors postBufferingBufsize(), setPostBufferingBufsize()
      */
     Q_PROPERTY(qint64 post_buffering_bufsize READ postBufferingBufsize WRITE setPostBufferingBufsize)
@@ -269,6 +278,50 @@ public:
     void setWebsocketMaxSize(int value);
     int websocketMaxSize() const;
 
+    /**
+     * Enables the permessage-deflate WebSocket extension (RFC 7692) when clients offer it
+     * @accessors %websocketCompression(), setWebsocketCompression()
+     */
+    Q_PROPERTY(bool websocket_compression READ websocketCompression WRITE setWebsocketCompression)
+    void setWebsocketCompression(bool enable);
+    bool websocketCompression() const;
+
+    /**
+     * Sets the maximum LZ77 window of WebSocket compression in bits (9 to 15, default 15),
+     * each step down halves the memory a compressing connection uses
+     * @accessors %websocketCompressionWindowBits(), setWebsocketCompressionWindowBits()
+     */
+    Q_PROPERTY(int websocket_compression_window_bits READ websocketCompressionWindowBits WRITE setWebsocketCompressionWindowBits)
+    void setWebsocketCompressionWindowBits(int bits);
+    int websocketCompressionWindowBits() const;
+
+    /**
+     * Requests both sides to reset the WebSocket compression context after each message,
+     * which makes compression worse but lets connections of a thread share their zlib streams
+     * @accessors %websocketCompressionNoContextTakeover(), setWebsocketCompressionNoContextTakeover()
+     */
+    Q_PROPERTY(bool websocket_compression_no_context_takeover READ websocketCompressionNoContextTakeover WRITE setWebsocketCompressionNoContextTakeover)
+    void setWebsocketCompressionNoContextTakeover(bool enable);
+    bool websocketCompressionNoContextTakeover() const;
+
+    /**
+     * Sets the number of seconds a WebSocket connection may stay idle before the server
+     * pings it, 0 (the default) disables server pings
+     * @accessors %websocketPingInterval(), setWebsocketPingInterval()
+     */
+    Q_PROPERTY(int websocket_ping_interval READ websocketPingInterval WRITE setWebsocketPingInterval)
+    void setWebsocketPingInterval(int seconds);
+    int websocketPingInterval() const;
+
+    /**
+     * Sets the number of seconds the peer has to answer a server ping before
+     * the WebSocket connection is closed (default 10)
+     * @accessors %websocketPongTimeout(), setWebsocketPongTimeout()
+     */
+    Q_PROPERTY(int websocket_pong_timeout READ websocketPongTimeout WRITE setWebsocketPongTimeout)
+    void setWebsocketPongTimeout(int seconds);
+    int websocketPongTimeout() const;
+
     /**
      * Defines the pid file to be written before privileges drop
      * @accessors pidfile(), setPidfile()
@@ -66,6 +66,7 @@ public:
     QStringList httpSockets;
     QStringList httpsSockets;
     QStringList fastcgiSockets;
+    QStringList uwsgiSockets;
     QStringList staticMaps;
     QStringList staticMaps2;
     QStringList touchReload;
@@ -89,9 +90,10 @@ public:
     bool reusePort = false;
 #endif
     qint64 postBuffering = -1;
-    qint64 postBufferingBufsize = 4096;
+    qint64 postBufferingBufsize = 64 * 1024;
     Protocol *protoHTTP = nullptr;
     Protocol *protoFCGI = nullptr;
+    Protocol *protoUWSGI = nullptr;
     AbstractFork *genericFork = nullptr;
     int bufferSize = 4096;
     int workersNotRunning = 1;
@@ -101,12 +103,17 @@ public:
     int socketReceiveBuf = -1;
     int socketTimeout = 4;
     int websocketMaxSize = 1024 * 1024;
+    int websocketCompressionWindowBits = 15;
+    int websocketPingInterval = 0;
+    int websocketPongTimeout = 10;
     bool lazy = false;
     bool master = false;
     bool autoReload = false;
     bool tcpNodelay = false;
     bool soKeepalive = false;
     bool threadBalancer = false;
+    bool websocketCompression = false;
+    bool websocketCompressionNoContextTakeover = false;
 
 Q_SIGNALS:
     void postForked(int workerId);